@@ -1,4 +1,6 @@
 #include "AffineMotion.h"
+#include "MeshIO.h"
+#include "Profile.h"
 
 using namespace std;
 
@@ -7,217 +9,123 @@ void AffineMotion::init()
 {
     setSelectRegionWidth(10);
     setSelectRegionHeight(10);
+
+    initGPU();
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-EdgePtr Mesh:: addEdge( NodePtr &n0, NodePtr &n1, FacePtr &face)
+void AffineMotion:: readMesh( const string &filename)
 {
-    NodePtr vmin = std::min(n0,n1);
-
-    for( auto oldedge : vmin->edges) {
-        if( oldedge->hasNodes(n0,n1)) {
-            oldedge->faces[1] = face;
-            return oldedge;
-        }
+    string errmsg;
+    if( !loadMesh( filename, srcmesh, errmsg) ) {
+        cout << "Warning: Input file not read: " << errmsg << endl;
+        return;
     }
 
-    EdgePtr newedge(new Edge(n0,n1));
-    newedge->faces[0] = face;
-    vmin->edges.push_back(newedge);
-    edges.push_back(newedge);
-    return newedge;
+    currmesh.coords = srcmesh.coords;
+    dstmesh.coords  = srcmesh.coords;
+    currmesh.shareConnectivity(srcmesh);
+    dstmesh.shareConnectivity(srcmesh);
 }
+
 ////////////////////////////////////////////////////////////////////////////////
 
-void Mesh::addFace( FacePtr &newface)
+void AffineMotion:: readAffinityMatrix( const string &filename)
 {
-    assert( newface );
-    auto n0 = newface->nodes[0]; assert( n0 );
-    auto n1 = newface->nodes[1]; assert( n1 );
-    auto n2 = newface->nodes[2]; assert( n2 );
-    assert((n0 != n1) && (n1 != n2) && (n2 != n0));
-
-    newface->edges[0] = addEdge(n0,n1,newface);
-    newface->edges[1] = addEdge(n1,n2,newface);
-    newface->edges[2] = addEdge(n2,n0,newface);
-
-    n0->faces.push_back(newface);
-    n1->faces.push_back(newface);
-    n2->faces.push_back(newface);
+    string errmsg;
+
+    // A keyframe chain is sampled at maxSteps times from its first to its
+    // last keyframe, each in closed form.
+    useKeyframes = filename.size() > 3 && filename.compare( filename.size() - 3, 3, ".kf") == 0;
+    if( useKeyframes) {
+        if( !keyframes.readKeyframes( filename, errmsg) ) {
+            cout << "Warning: " << errmsg << endl;
+            useKeyframes = 0;
+            return;
+        }
+        A  = keyframes.getKeyframe( keyframes.getNumKeyframes() - 1);
+        dt = (keyframes.getEndTime() - keyframes.getStartTime())/(double)maxSteps;
+    } else {
+        if( !motion.readAffinityMatrix( filename, errmsg) ) {
+            cout << "Warning: " << errmsg << endl;
+            return;
+        }
+        A  = motion.getMatrix();
+        dt = 1.0/(double)maxSteps;
+        stepper.start( motion, dt);
+    }
 
-    faces.push_back(newface);
+    startPos = {0.0, 0.0, 0.0};
+    endPos   = {A(3,0), A(3,1), A(3,2)};
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Mesh::setSurfaceNormals()
-{
-    for( auto f: faces) {
-        auto p0 = f->nodes[0]->xyz;
-        auto p1 = f->nodes[1]->xyz;
-        auto p2 = f->nodes[2]->xyz;
-        f->normal = normal(p0,p1,p2);
-    }
-}
 
-void AffineMotion:: readMesh( const string &filename)
+void AffineMotion::mult( Eigen::Matrix4d &At, Mesh &msh)
 {
-    ifstream ifile( filename.c_str(), ios::in);
-    if( ifile.fail() ) {
-        cout << "Warning: Input file not read " << endl;
-        return;
-    }
-    string str;
-    ifile >> str;
-    if( str != "OFF") {
-        cout << "Warning: Input file not in Off format" << endl;
-        return;
-    }
-
-    size_t numNodes, numFaces, numEdges;
-    ifile >> numNodes >> numFaces >> numEdges;
-
-    double x, y, z;
-
-    srcmesh.nodes.resize(numNodes);
-    for( size_t i = 0; i < numNodes; i++) {
-        ifile >> x >> y >> z;
-        NodePtr v = Node::newObject();
-        v->xyz[0] = x;
-        v->xyz[1] = y;
-        v->xyz[2] = z;
-        v->id     = i;
-        srcmesh.nodes[i] = v;
-    }
-
-    size_t index = 0;
-    int dummy, v0, v1, v2;
-
-    for( size_t i = 0; i < numFaces; i++) {
-        ifile >> dummy >> v0 >> v1 >> v2;
-        assert( dummy == 3);
-        NodePtr n0   = srcmesh.nodes[v0];
-        NodePtr n1   = srcmesh.nodes[v1];
-        NodePtr n2   = srcmesh.nodes[v2];
-        FacePtr newface = Face::newObject(n0,n1,n2);
-        newface->id     = i;
-        srcmesh.addFace(newface);
-    }
-
-    currmesh.nodes.resize(numNodes);
-    dstmesh.nodes.resize(numNodes);
-
-    NodePtr v;
-    for( int i = 0; i < numNodes; i++) {
-        v = Node::newObject();
-        v->xyz    = srcmesh.nodes[i]->xyz;
-        v->id     = i;
-        currmesh.nodes[i] = v;
-
-        v = Node::newObject();
-        v->xyz    = srcmesh.nodes[i]->xyz;
-        v->id     = i;
-        dstmesh.nodes[i] = v;
-    }
-
-    currmesh.faces.resize(numFaces);
-    dstmesh.faces.resize(numFaces);
-
-    FacePtr newface;
-    int n0, n1, n2;
-    for( size_t i = 0; i < numFaces; i++) {
-        n0 = srcmesh.faces[i]->nodes[0]->id;
-        n1 = srcmesh.faces[i]->nodes[1]->id;
-        n2 = srcmesh.faces[i]->nodes[2]->id;
-        newface = std::make_shared<Face>();
-        newface->nodes[0] = currmesh.nodes[n0];
-        newface->nodes[1] = currmesh.nodes[n1];
-        newface->nodes[2] = currmesh.nodes[n2];
-        currmesh.faces[i] = newface;
-
-        newface = std::make_shared<Face>();
-        newface->nodes[0] = dstmesh.nodes[n0];
-        newface->nodes[1] = dstmesh.nodes[n1];
-        newface->nodes[2] = dstmesh.nodes[n2];
-        dstmesh.faces[i] = newface;
-    }
-    dt = 1.0/(double)maxSteps;
-
-    srcmesh.setSurfaceNormals();
-    currmesh.setSurfaceNormals();
-    dstmesh.setSurfaceNormals();
+    applyMotion( At, srcmesh, msh);
+    applyNormalMotion( At, srcmesh, msh);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void AffineMotion:: readAffinityMatrix( const string &filename)
+Eigen::Matrix4d AffineMotion::getPose( double t) const
 {
-    ifstream ifile( filename.c_str(), ios::in);
-
-    Eigen::Matrix4d aa;
-    for( int i = 0; i < 4; i++)
-        ifile >> aa(i,0) >> aa(i,1) >> aa(i,2) >> aa(i,3);
-
-    A = aa.transpose();   // Prof. Shizuo Kaji, the author of AfflineLib helped..
-
-    logA =  AffineLib::logSEc(A);
-
-    startPos = {0.0, 0.0, 0.0};
-    endPos   = {A(3,0), A(3,1), A(3,2)};
+    return useKeyframes ? keyframes.getMatrix(t) : motion.getMatrix(t);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void Mesh::saveAs( const std::string &filename)
+void AffineMotion::startAnimation()
 {
-    ofstream ofile(filename.c_str(), ios::out);
-
-    size_t  numnodes = 0;
-    for( auto v: nodes) {
-        if( v->active ) v->id = numnodes++;
+    // The worker only reads srcmesh and the motion, which stay fixed while
+    // the animation runs.
+    if( !pipeline.isRunning() ) {
+        pipeline.start( srcmesh, [this](double t, Mesh &dst) {
+            Eigen::Matrix4d Mt = getPose(t);
+            applyMotion( Mt, srcmesh, dst);
+            applyNormalMotion( Mt, srcmesh, dst);
+        });
     }
 
-    set<NodePtr> vSet;
-    size_t  numfaces = 0;
-    for( auto f: faces) {
-        if( f->active ) {
-            vSet.insert(f->nodes[0]);
-            vSet.insert(f->nodes[1]);
-            vSet.insert(f->nodes[2]);
-            numfaces++;
-        }
-    }
+    double span = getEndTime() - getStartTime();
+    playPhase = span > 0.0 ? (playTime - getStartTime())/span : 0.0;
+    playClock.start();
+    QGLViewer::startAnimation();
+}
 
-    size_t index = 0;
-    for( auto v: vSet) {
-        v->id = index++;
-        ofile << "v " << v->xyz[0] << " " << v->xyz[1] << " " << v->xyz[2] << endl;
-    }
+////////////////////////////////////////////////////////////////////////////////
 
-    for( auto f: faces) {
-        if( f->active )
-            ofile << "f " << f->nodes[0]->id +1 << " "
-                  << f->nodes[1]->id +1 << " "
-                  << f->nodes[2]->id +1 << endl;
-    }
+void AffineMotion::stopAnimation()
+{
+    QGLViewer::stopAnimation();
+    pipeline.stop();
+
+    // Hold the pose that was shown last.
+    if( !(useGPU && gpuReady) ) playTime = pipeline.getFrontTime();
+    At = getPose(playTime);
+    nstep = max(nstep, 1);
+    currValid = 0;
+    update();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void AffineMotion::mult( Eigen::Matrix4d &At, Mesh &msh)
+void AffineMotion::animate()
 {
-    int numnodes = srcmesh.nodes.size();
-    Eigen::Vector4d vec;
-
-    for( int i = 0; i < numnodes; i++) {
-        vec[0] = srcmesh.nodes[i]->xyz[0];
-        vec[1] = srcmesh.nodes[i]->xyz[1];
-        vec[2] = srcmesh.nodes[i]->xyz[2];
-        vec[3] = 1.0;
-        auto x = At.transpose()*vec;  // Prof. Kaji helped me here.
-        msh.nodes[i]->xyz[0] = x[0];
-        msh.nodes[i]->xyz[1] = x[1];
-        msh.nodes[i]->xyz[2] = x[2];
+    // Follow the wall clock, so that frames the worker cannot keep up with
+    // are skipped instead of slowing the motion down.
+    double elapsed = playClock.elapsed()/(double)(maxSteps*animationPeriod());
+    double phase   = fmod( playPhase + elapsed, 1.0);
+    playTime = getStartTime() + phase*(getEndTime() - getStartTime());
+
+    if( useGPU && gpuReady) {
+        At = getPose(playTime);
+        return;
     }
+
+    pipeline.request(playTime);
+    pipeline.acquire();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -251,10 +159,9 @@ void AffineMotion::keyPressEvent( QKeyEvent *e)
 
     if( e->key() == Qt::Key_N) {
         nstep++;
-        double t = nstep*dt;
-        if( t <= 1.0) {
-            At  = AffineLib::expSE(t*logA);
-            mult( At, currmesh);
+        if( nstep <= maxSteps) {
+            At  = useKeyframes ? keyframes.getMatrix( keyframes.getStartTime() + nstep*dt) : stepper.step();
+            currValid = 0;
             update();
         }
         return;
@@ -262,12 +169,16 @@ void AffineMotion::keyPressEvent( QKeyEvent *e)
 
     if( e->key() == Qt::Key_R) {
         nstep = 1;
-        double t = nstep*dt;
-        if( t <= 1.0) {
-            At  = AffineLib::expSE(t*logA);
-            mult( At, currmesh);
-            update();
-        }
+        stepper.reset();
+        At  = useKeyframes ? keyframes.getMatrix( keyframes.getStartTime() + dt) : stepper.step();
+        currValid = 0;
+        update();
+        return;
+    }
+
+    if( e->key() == Qt::Key_V) {
+        useGPU = !useGPU;
+        update();
         return;
     }
     if( e->key() == Qt::Key_Home) {
@@ -308,34 +219,72 @@ void AffineMotion::mouseReleaseEvent( QMouseEvent *e)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void AffineMotion::drawFaces(Mesh &themesh)
+void AffineMotion::drawFaces(const Mesh &themesh)
 {
     if( useLights ) glEnable(GL_LIGHTING);
 
-    for ( auto f : themesh.faces) {
-        if(f->active) {
-            glBegin(GL_TRIANGLES);
-	    glNormal3fv( &f->normal[0]);
-            glVertex3fv( &f->nodes[0]->xyz[0] );
-            glVertex3fv( &f->nodes[1]->xyz[0] );
-            glVertex3fv( &f->nodes[2]->xyz[0] );
-            glEnd();
-        }
+    size_t numfaces = themesh.getNumFaces();
+    PROFILE_COUNT("faces drawn", numfaces);
+
+    const int   *tri = themesh.getTriangles().data();
+    const float *nrm = themesh.normals.data();
+
+    glBegin(GL_TRIANGLES);
+    for( size_t i = 0; i < numfaces; i++) {
+        glNormal3fv( nrm + 3*i );
+        glVertex3fv( themesh.getXYZ(tri[3*i+0]) );
+        glVertex3fv( themesh.getXYZ(tri[3*i+1]) );
+        glVertex3fv( themesh.getXYZ(tri[3*i+2]) );
     }
+    glEnd();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 void AffineMotion::draw()
 {
-    if( nstep == 0) {
-        mult(A, dstmesh);
-    }
+    PROFILE_SCOPE("draw");
 
     glPolygonOffset(1.0,1.0);
     glEnable(GL_POLYGON_OFFSET_LINE);
 
     glPolygonMode( GL_FRONT_AND_BACK, GL_FILL);
+
+    if( useGPU && gpuReady ) {
+        glColor3f( 1.0, 0.0, 0.0);
+        drawGPU( Eigen::Matrix4d::Identity() );
+
+        glColor3f( 0.0, 0.0, 1.0);
+        drawGPU( A );
+
+        if( nstep || animationIsStarted() ) {
+            glColor3f( 0.0, 1.0, 0.0);
+            drawGPU( At );
+        }
+        return;
+    }
+
+    if( animationIsStarted() ) {
+        glColor3f( 1.0, 0.0, 0.0);
+        drawFaces(srcmesh);
+
+        glColor3f( 0.0, 0.0, 1.0);
+        drawFaces(dstmesh);
+
+        glColor3f( 0.0, 1.0, 0.0);
+        drawFaces(pipeline.getFront());
+        return;
+    }
+
+    if( nstep == 0) {
+        mult(A, dstmesh);
+    }
+
+    if( nstep && !currValid ) {
+        mult(At, currmesh);
+        currValid = 1;
+    }
+
     glColor3f( 1.0, 0.0, 0.0);
     drawFaces(srcmesh);
 
@@ -349,3 +298,115 @@ void AffineMotion::draw()
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+
+void AffineMotion::postDraw()
+{
+    QGLViewer::postDraw();
+    PROFILE_FRAME();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const char *vertexShaderSource =
+    "#version 120\n"
+    "uniform mat4 motion;\n"
+    "uniform mat3 normalMotion;\n"
+    "attribute vec3 position;\n"
+    "attribute vec3 normal;\n"
+    "varying vec3 eyeNormal;\n"
+    "void main() {\n"
+    "    eyeNormal     = gl_NormalMatrix * (normalMotion * normal);\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_Position   = gl_ModelViewProjectionMatrix * (motion * vec4(position, 1.0));\n"
+    "}\n";
+
+static const char *fragmentShaderSource =
+    "#version 120\n"
+    "uniform bool useLights;\n"
+    "varying vec3 eyeNormal;\n"
+    "void main() {\n"
+    "    vec4 color = gl_Color;\n"
+    "    if( useLights ) {\n"
+    "        vec3 n = normalize(eyeNormal);\n"
+    "        vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+    "        color.rgb *= 0.2 + 0.8*abs(dot(n, l));\n"
+    "    }\n"
+    "    gl_FragColor = color;\n"
+    "}\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+void AffineMotion::initGPU()
+{
+    // GLSL 1.20 keeps this usable on compatibility contexts such as Mesa
+    // llvmpipe; on failure the immediate-mode path is used instead.
+    gpuReady = 0;
+    if( !program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource) ||
+        !program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource) ||
+        !program.link() ) {
+        cout << "Warning: GPU path disabled: " << program.log().toStdString() << endl;
+        return;
+    }
+
+    size_t numnodes = srcmesh.getNumNodes();
+    if( numnodes == 0) return;
+
+    srcmesh.setVertexNormals();
+
+    vector<float> vertices(6*numnodes);
+    for( size_t i = 0; i < numnodes; i++) {
+        for( int j = 0; j < 3; j++) {
+            vertices[6*i+j]   = srcmesh.coords[3*i+j];
+            vertices[6*i+3+j] = srcmesh.vertexNormals[3*i+j];
+        }
+    }
+
+    vertexBuffer.create();
+    vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    vertexBuffer.bind();
+    vertexBuffer.allocate(vertices.data(), vertices.size()*sizeof(float));
+    vertexBuffer.release();
+
+    const MeshBuffer<int> &triangles = srcmesh.getTriangles();
+    indexBuffer.create();
+    indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    indexBuffer.bind();
+    indexBuffer.allocate(triangles.data(), triangles.size()*sizeof(int));
+    indexBuffer.release();
+
+    gpuReady = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void AffineMotion::drawGPU( const Eigen::Matrix4d &mat)
+{
+    // mat acts on row vectors; the shader uses column vectors. Qt takes the
+    // matrices in row-major order.
+    Eigen::Matrix<float,4,4,Eigen::RowMajor> motion = mat.transpose().cast<float>();
+    Eigen::Matrix<float,3,3,Eigen::RowMajor> normalMotion = motion.topLeftCorner<3,3>().inverse().transpose();
+
+    PROFILE_COUNT("faces drawn", srcmesh.getNumFaces());
+
+    program.bind();
+    program.setUniformValue("useLights", (GLint)useLights);
+    program.setUniformValue("motion", QMatrix4x4(motion.data()));
+    program.setUniformValue("normalMotion", QMatrix3x3(normalMotion.data()));
+
+    vertexBuffer.bind();
+    program.enableAttributeArray("position");
+    program.enableAttributeArray("normal");
+    program.setAttributeBuffer("position", GL_FLOAT, 0, 3, 6*sizeof(float));
+    program.setAttributeBuffer("normal", GL_FLOAT, 3*sizeof(float), 3, 6*sizeof(float));
+
+    indexBuffer.bind();
+    glDrawElements(GL_TRIANGLES, srcmesh.getTriangles().size(), GL_UNSIGNED_INT, nullptr);
+    indexBuffer.release();
+
+    program.disableAttributeArray("position");
+    program.disableAttributeArray("normal");
+    vertexBuffer.release();
+    program.release();
+}
+
+////////////////////////////////////////////////////////////////////////////////
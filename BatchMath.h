@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cmath>
+
+#include "affinelib.h"
+
+// Scalar building blocks of the batched kernels in TransformBatch.cpp and
+// Skinning.cpp. They are written without branches and always inlined, so
+// that the loops calling them vectorize and each instruction set gets its own
+// copy. The polynomials are those of the Cephes library.
+
+#define BATCH_INLINE inline __attribute__((always_inline))
+
+namespace BatchMath {
+
+BATCH_INLINE double polevl( double x, const double *c, int n)
+{
+    double y = c[0];
+    for( int i = 1; i <= n; i++) y = y*x + c[i];
+    return y;
+}
+
+// Round to the nearest integer in the default rounding mode, |x| < 2^51.
+BATCH_INLINE double roundNearest( double x)
+{
+    const double MAGIC = 6755399441055744.0;
+    return (x + MAGIC) - MAGIC;
+}
+
+// sin and cos of x >= 0, reduced by multiples of pi/4.
+BATCH_INLINE void sinCos( double x, double &s, double &c)
+{
+    static const double sincof[] = {
+         1.58962301576546568060E-10, -2.50507477628578072866E-8,
+         2.75573136213857245213E-6,  -1.98412698295895385996E-4,
+         8.33333333332211858878E-3,  -1.66666666666666307295E-1 };
+    static const double coscof[] = {
+        -1.13585365213876817300E-11,  2.08757008419747316778E-9,
+        -2.75573141792967388112E-7,   2.48015872888517045348E-5,
+        -1.38888888888730564116E-3,   4.16666666666665929218E-2 };
+    const double DP1 = 7.85398125648498535156E-1;
+    const double DP2 = 3.77489470793079817668E-8;
+    const double DP3 = 2.69515142907905952645E-15;
+
+    // Even octant j nearest to x, and x - j pi/4 in [-pi/4, pi/4].
+    double y = 2.0*roundNearest( 0.5*x*(4.0/M_PI) );
+    double z = ((x - y*DP1) - y*DP2) - y*DP3;
+    double zz = z*z;
+
+    double ps = z + z*zz*polevl(zz, sincof, 5);
+    double pc = 1.0 - 0.5*zz + zz*zz*polevl(zz, coscof, 5);
+
+    // j mod 8 is 0, 2, 4 or 6.
+    double j = y - 8.0*roundNearest( (y - 3.0)/8.0 );
+    // Every select tests a single comparison, which keeps them vectorizable.
+    double sw = fabs(j - 4.0) == 2.0 ? pc : ps;
+    double cw = fabs(j - 4.0) == 2.0 ? ps : pc;
+    s = j >= 4.0 ? -sw : sw;
+    c = fabs(j - 3.0) == 1.0 ? -cw : cw;
+}
+
+// For a skew matrix W whose three upper entries have squares summing to
+// norm2, AffineLib::expSE gives exp(W) = I + a W + b W^2 and moves the
+// translation v of the log to v + b vW + d vW^2. As in AffineLib, below an
+// angle of 1e-2 the coefficients come from their series, and below a
+// quarter turn 1 - cos is taken as sin^2/(1 + cos) so that it does not
+// cancel.
+BATCH_INLINE void expSECoefficients( double norm2, double &a, double &b, double &d)
+{
+    bool   small = norm2 < 1.0e-4;
+    double theta = sqrt( small ? 1.0 : norm2);
+    double s, c;
+    sinCos(theta, s, c);
+
+    double omc = c > 0.0 ? s*s/(1.0 + c) : 1.0 - c;
+    a = small ? 1.0 - norm2/6.0 + norm2*norm2/120.0 : s/theta;
+    b = small ? 0.5 - norm2/24.0 + norm2*norm2/720.0 : omc/norm2;
+    d = small ? 1.0/6.0 - norm2/120.0 + norm2*norm2/5040.0 : (theta - s)/(theta*norm2);
+}
+
+} // namespace BatchMath
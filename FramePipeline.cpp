@@ -0,0 +1,113 @@
+#include "FramePipeline.h"
+#include "Profile.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+void FramePipeline::start( const Mesh &src, Compute fn)
+{
+    stop();
+
+    for( int i = 0; i < 3; i++) {
+        buffers[i].coords        = src.coords;
+        buffers[i].normals       = src.normals;
+        buffers[i].vertexNormals = src.vertexNormals;
+        buffers[i].shareConnectivity(src);
+        times[i] = 0.0;
+    }
+    front = 0;
+    back  = 1;
+    ready.store(2);
+
+    compute     = fn;
+    requestSeq  = 0;
+    startedSeq  = 0;
+    busy        = 0;
+    quit        = 0;
+    numComputed = 0;
+    numDropped  = 0;
+
+    worker = thread( &FramePipeline::workerLoop, this);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void FramePipeline::stop()
+{
+    if( !worker.joinable() ) return;
+
+    {
+        lock_guard<mutex> lock(requestMutex);
+        quit = 1;
+    }
+    requestReady.notify_one();
+    worker.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void FramePipeline::request( double t)
+{
+    {
+        lock_guard<mutex> lock(requestMutex);
+        requestTime = t;
+        requestSeq++;
+    }
+    requestReady.notify_one();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool FramePipeline::acquire()
+{
+    if( !(ready.load(memory_order_acquire) & FRESH) ) return 0;
+
+    // Only the worker sets FRESH, so the flag is still set here and the
+    // exchange takes the new frame.
+    front = ready.exchange( front, memory_order_acq_rel) & ~FRESH;
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool FramePipeline::isIdle() const
+{
+    lock_guard<mutex> lock(requestMutex);
+    return !busy && startedSeq == requestSeq;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void FramePipeline::workerLoop()
+{
+    for(;;) {
+        double t;
+        {
+            unique_lock<mutex> lock(requestMutex);
+            busy = 0;
+            requestReady.wait( lock, [this]() { return quit || requestSeq != startedSeq; });
+            if( quit) return;
+
+            // Requests that came in while the last frame was computed are
+            // superseded by the newest one.
+            numDropped += requestSeq - startedSeq - 1;
+            startedSeq  = requestSeq;
+            t    = requestTime;
+            busy = 1;
+        }
+
+        {
+            PROFILE_SCOPE("FramePipeline::compute");
+            compute( t, buffers[back]);
+        }
+        times[back] = t;
+        numComputed++;
+
+        // Publish the frame and take back the buffer it replaces, which is
+        // either a frame the renderer never took or the renderer's old front.
+        int old = ready.exchange( back | FRESH, memory_order_acq_rel);
+        back = old & ~FRESH;
+        if( old & FRESH) numDropped++;
+    }
+}
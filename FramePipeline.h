@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Mesh.h"
+
+// Computes animation frames on a worker thread while the render thread draws
+// the last finished one. The frames live in three poses of one mesh that
+// share its connectivity: the front one is being drawn, the back one is being
+// computed, and the third holds the newest finished frame until the renderer
+// takes it. Handing a frame over is a single atomic exchange of buffer
+// indices on either side, so neither thread ever waits for the other.
+//
+// Playback is throttled by dropping frames rather than by slowing down: a
+// request replaces any earlier one that the worker has not started, and a
+// finished frame replaces an earlier one that the renderer has not taken.
+
+class FramePipeline
+{
+public:
+    // Writes the frame at time t into dst, which starts as a copy of the source
+    // pose; runs on the worker thread.
+    typedef std::function<void(double t, Mesh &dst)> Compute;
+
+    FramePipeline() {}
+    ~FramePipeline() { stop(); }
+
+    FramePipeline( const FramePipeline &) = delete;
+    FramePipeline &operator=( const FramePipeline &) = delete;
+
+    // Copy the geometry of src into the three buffers and start the worker.
+    // src is not referenced afterwards, but compute may refer to it.
+    void start( const Mesh &src, Compute compute);
+
+    // Finish the frame in progress and join the worker.
+    void stop();
+
+    bool isRunning() const { return worker.joinable(); }
+
+    // Ask for the frame at time t and return at once.
+    void request( double t);
+
+    // Render thread only: make the newest finished frame the front one, and
+    // return whether there was one newer than the current front frame.
+    bool acquire();
+
+    // Render thread only: the frame to draw and its time. Before the first
+    // acquire() it is the source pose at time 0.
+    const Mesh &getFront()     const { return buffers[front]; }
+    double      getFrontTime() const { return times[front]; }
+
+    // True while no request is waiting and no frame is being computed.
+    bool isIdle() const;
+
+    long getNumComputed() const { return numComputed; }
+    long getNumDropped()  const { return numDropped; }
+
+private:
+    static const int FRESH = 4;   // flag of a finished frame not yet taken
+
+    Mesh   buffers[3];
+    double times[3] = { 0.0, 0.0, 0.0 };
+    int    front = 0;             // owned by the render thread
+    int    back  = 1;             // owned by the worker
+    std::atomic<int> ready{2};    // index of the third buffer, plus FRESH
+
+    Compute     compute;
+    std::thread worker;
+
+    // Only guards the request; the worker sleeps on it between frames.
+    mutable std::mutex      requestMutex;
+    std::condition_variable requestReady;
+    double requestTime = 0.0;
+    long   requestSeq  = 0;
+    long   startedSeq  = 0;
+    bool   busy        = 0;
+    bool   quit        = 0;
+
+    std::atomic<long> numComputed{0}, numDropped{0};
+
+    void workerLoop();
+};
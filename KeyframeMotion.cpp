@@ -0,0 +1,105 @@
+#include "KeyframeMotion.h"
+#include "Profile.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool KeyframeMotion::readKeyframes( const string &filename, string &errmsg)
+{
+    ifstream ifile( filename.c_str(), ios::in);
+    if( ifile.fail() ) {
+        errmsg = filename + ": cannot open file";
+        return 0;
+    }
+
+    // Strip the comments, then read the numbers regardless of line breaks.
+    stringstream numbers;
+    string line;
+    while( getline(ifile, line) )
+        numbers << line.substr(0, line.find('#')) << '\n';
+
+    vector<double>          t;
+    vector<Eigen::Matrix4d> P;
+    double ti;
+    while( numbers >> ti) {
+        Eigen::Matrix4d aa;
+        for( int i = 0; i < 4; i++)
+            numbers >> aa(i,0) >> aa(i,1) >> aa(i,2) >> aa(i,3);
+        if( numbers.fail() ) {
+            errmsg = filename + ": expected 16 matrix entries after time " + to_string(ti);
+            return 0;
+        }
+        t.push_back(ti);
+        P.push_back( aa.transpose() );
+    }
+
+    if( !numbers.eof() ) {
+        errmsg = filename + ": expected a keyframe time";
+        return 0;
+    }
+
+    if( !setKeyframes( t, P, errmsg) ) {
+        errmsg = filename + ": " + errmsg;
+        return 0;
+    }
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool KeyframeMotion::setKeyframes( const vector<double> &t, const vector<Eigen::Matrix4d> &P,
+                                   string &errmsg)
+{
+    PROFILE_SCOPE("KeyframeMotion::setKeyframes");
+
+    if( t.empty() || t.size() != P.size() ) {
+        errmsg = "expected one time per keyframe and at least one keyframe";
+        return 0;
+    }
+
+    for( size_t i = 0; i < t.size(); i++) {
+        if( i > 0 && !(t[i] > t[i-1]) ) {
+            errmsg = "keyframe times must increase, at keyframe " + to_string(i);
+            return 0;
+        }
+        if( P[i].topLeftCorner<3,3>().determinant() <= 0.0) {
+            errmsg = "keyframe " + to_string(i) + " does not preserve orientation";
+            return 0;
+        }
+    }
+
+    times = t;
+    poses = P;
+    segments.assign( t.size() - 1, SteadyMotion() );
+    for( size_t i = 0; i + 1 < t.size(); i++)
+        segments[i].setMatrix( P[i].inverse()*P[i+1] );
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t KeyframeMotion::findSegment( double t) const
+{
+    if( segments.empty() ) return 0;
+
+    size_t i = upper_bound( times.begin(), times.end(), t) - times.begin();
+    return min( i > 0 ? i - 1 : 0, segments.size() - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix4d KeyframeMotion::getMatrix( double t) const
+{
+    if( segments.empty() )
+        return poses.empty() ? Eigen::Matrix4d::Identity() : poses[0];
+
+    size_t i = findSegment(t);
+    double s = (t - times[i])/(times[i+1] - times[i]);
+    s = max( 0.0, min( s, 1.0) );
+    return poses[i]*segments[i].getMatrix(s);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "SteadyMotion.h"
+
+// Chain of steady motions through keyframe poses P_0, ..., P_{n-1} at
+// increasing times t_0 < ... < t_{n-1}. Between t_i and t_{i+1} the pose is
+//     P(t) = P_i D_i(s),   s = (t - t_i)/(t_{i+1} - t_i),
+// where D_i(s) is the SteadyMotion from the identity to P_i^-1 P_{i+1}. Every
+// segment takes the principal screw log of its own relative motion, so it
+// turns by at most a half turn, the short way. All segments are factored
+// once in setKeyframes(); a pose at any time then costs a binary search over
+// the keyframe times and one SteadyMotion evaluation, whatever the previous
+// time was. Matrices follow the AffineLib convention of acting on row
+// vectors.
+
+class KeyframeMotion
+{
+public:
+    // Read a ".kf" file: for every keyframe its time followed by the 16
+    // entries of its 4x4 matrix as in a ".xf" file (acting on column vectors,
+    // row by row). Line breaks are free and "#" starts a comment.
+    bool readKeyframes( const std::string &filename, std::string &errmsg);
+
+    // The times must increase strictly and every pose must have a positive
+    // determinant.
+    bool setKeyframes( const std::vector<double> &times, const std::vector<Eigen::Matrix4d> &poses,
+                       std::string &errmsg);
+
+    size_t getNumKeyframes() const { return times.size(); }
+    double getStartTime()    const { return times.empty() ? 0.0 : times.front(); }
+    double getEndTime()      const { return times.empty() ? 0.0 : times.back(); }
+
+    double                 getTime( size_t i)     const { return times[i]; }
+    const Eigen::Matrix4d &getKeyframe( size_t i) const { return poses[i]; }
+
+    // Motion from keyframe i to keyframe i+1.
+    const SteadyMotion &getSegment( size_t i) const { return segments[i]; }
+
+    // Segment i with t_i <= t < t_{i+1}, clamped to the first and last ones.
+    size_t findSegment( double t) const;
+
+    // Pose at time t; the first and last poses hold outside [t_0, t_{n-1}].
+    Eigen::Matrix4d getMatrix( double t) const;
+
+private:
+    std::vector<double>          times;
+    std::vector<Eigen::Matrix4d> poses;
+    std::vector<SteadyMotion>    segments;
+};
@@ -0,0 +1,48 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool MappedFile::open( const std::string &filename, bool copyOnWrite)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if( fd < 0) return 0;
+
+    struct stat st;
+    if( fstat(fd, &st) != 0) {
+        close();
+        return 0;
+    }
+
+    length = st.st_size;
+    if( length == 0) return 1;
+
+    int prot = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    addr = mmap(nullptr, length, prot, MAP_PRIVATE, fd, 0);
+    if( addr == MAP_FAILED) {
+        addr = nullptr;
+        close();
+        return 0;
+    }
+    madvise(addr, length, MADV_SEQUENTIAL);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MappedFile::close()
+{
+    if( addr ) munmap(addr, length);
+    if( fd >= 0) ::close(fd);
+    addr   = nullptr;
+    length = 0;
+    fd     = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
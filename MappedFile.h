@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Memory mapping of a whole file. The mapping is private, so pages are shared
+// with the page cache until someone writes to them, and writes never reach
+// the file.
+
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile( const MappedFile &) = delete;
+    MappedFile &operator=( const MappedFile &) = delete;
+
+    // Returns false and leaves the object empty if the file cannot be mapped.
+    // With copyOnWrite set the pages are also writable.
+    bool open( const std::string &filename, bool copyOnWrite = 0);
+    void close();
+
+    bool isOpen() const { return fd >= 0; }
+
+    const char *data() const { return static_cast<const char*>(addr); }
+    char *data() { return static_cast<char*>(addr); }
+    size_t size() const { return length; }
+
+private:
+    void   *addr   = nullptr;
+    size_t  length = 0;
+    int     fd     = -1;
+};
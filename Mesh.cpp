@@ -0,0 +1,237 @@
+#include "Mesh.h"
+#include "MeshWriter.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+
+#include <iostream>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+EdgePtr Mesh:: addEdge( NodePtr &n0, NodePtr &n1, FacePtr &face)
+{
+    NodePtr vmin = (n0->id < n1->id) ? n0 : n1;
+
+    for( auto oldedge : vmin->edges) {
+        if( oldedge->hasNodes(n0,n1)) {
+            oldedge->faces[1] = face;
+            return oldedge;
+        }
+    }
+
+    EdgePtr newedge = newEdge(n0,n1);
+    newedge->faces[0] = face;
+    vmin->edges.push_back(newedge);
+    edges.push_back(newedge);
+    return newedge;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Mesh::addFace( FacePtr &newface)
+{
+    assert( newface );
+    auto n0 = newface->nodes[0]; assert( n0 );
+    auto n1 = newface->nodes[1]; assert( n1 );
+    auto n2 = newface->nodes[2]; assert( n2 );
+    assert((n0 != n1) && (n1 != n2) && (n2 != n0));
+
+    newface->edges[0] = addEdge(n0,n1,newface);
+    newface->edges[1] = addEdge(n1,n2,newface);
+    newface->edges[2] = addEdge(n2,n0,newface);
+
+    n0->faces.push_back(newface);
+    n1->faces.push_back(newface);
+    n2->faces.push_back(newface);
+
+    faces.push_back(newface);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const MeshTopology &MeshConnectivity::getTopology() const
+{
+    if( !topologyBuilt ) {
+        lock_guard<mutex> lock(topologyMutex);
+        if( !topologyBuilt ) {
+            topology.build( triangles.data(), getNumFaces(), numNodes);
+            topologyBuilt = 1;
+        }
+    }
+    return topology;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MeshConnectivity::setTopology( MeshTopology &&t)
+{
+    lock_guard<mutex> lock(topologyMutex);
+    topology      = std::move(t);
+    topologyBuilt = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Mesh::buildTopology()
+{
+    PROFILE_SCOPE("Mesh::buildTopology");
+
+    clearTopology();
+
+    size_t numnodes = getNumNodes();
+    size_t numfaces = getNumFaces();
+    if( normals.size() != 3*numfaces) normals.resize(3*numfaces);
+    const MeshBuffer<int> &triangles = getTriangles();
+    const MeshTopology    &topology  = getTopology();
+
+    size_t numedges = topology.getNumEdges();
+    nodePool.reserve(numnodes);
+    edgePool.reserve(numedges);
+    facePool.reserve(numfaces);
+
+    nodes.resize(numnodes);
+    for( size_t i = 0; i < numnodes; i++) {
+        NodePtr v = newNode();
+        v->xyz    = getXYZ(i);
+        v->id     = i;
+        nodes[i]  = v;
+    }
+
+    faces.resize(numfaces);
+    for( size_t i = 0; i < numfaces; i++) {
+        NodePtr n0 = nodes[triangles[3*i+0]];
+        NodePtr n1 = nodes[triangles[3*i+1]];
+        NodePtr n2 = nodes[triangles[3*i+2]];
+        FacePtr newface = newFace(n0,n1,n2);
+        newface->id     = i;
+        newface->normal = &normals[3*i];
+        faces[i] = newface;
+    }
+
+    edges.resize(numedges);
+    for( size_t i = 0; i < numedges; i++) {
+        NodePtr n0 = nodes[topology.edgeNodes[2*i+0]];
+        NodePtr n1 = nodes[topology.edgeNodes[2*i+1]];
+        EdgePtr newedge = newEdge(n0,n1);
+        int first = topology.edgeFaceOffsets[i];
+        newedge->faces[0] = faces[topology.edgeFaces[first]];
+        if( topology.getNumFaces(i) > 1)
+            newedge->faces[1] = faces[topology.edgeFaces[first+1]];
+        if( topology.isBoundary(i)) {
+            n0->boundary = 1;
+            n1->boundary = 1;
+        }
+        n0->edges.push_back(newedge);
+        edges[i] = newedge;
+    }
+
+    for( size_t i = 0; i < numfaces; i++) {
+        for( int k = 0; k < 3; k++)
+            faces[i]->edges[k] = edges[topology.faceEdges[3*i+k]];
+    }
+
+    for( size_t i = 0; i < numnodes; i++) {
+        nodes[i]->faces.reserve( topology.nodeFaceOffsets[i+1] - topology.nodeFaceOffsets[i]);
+        for( int j = topology.nodeFaceOffsets[i]; j < topology.nodeFaceOffsets[i+1]; j++)
+            nodes[i]->faces.push_back( faces[topology.nodeFaces[j]] );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Mesh::clearTopology()
+{
+    nodes.clear();
+    edges.clear();
+    faces.clear();
+    nodePool.clear();
+    edgePool.clear();
+    facePool.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Mesh::setSurfaceNormals()
+{
+    PROFILE_SCOPE("setSurfaceNormals");
+
+    size_t numfaces = getNumFaces();
+    normals.resize(3*numfaces);
+
+    ThreadPool::instance().parallelFor( numfaces, FACE_CHUNK, [this](size_t begin, size_t end) {
+        setSurfaceNormals(begin, end);
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Mesh::setSurfaceNormals( size_t begin, size_t end)
+{
+    const int *tri = getTriangles().data();
+    for( size_t i = begin; i < end; i++) {
+        const float *x0 = getXYZ(tri[3*i+0]);
+        const float *x1 = getXYZ(tri[3*i+1]);
+        const float *x2 = getXYZ(tri[3*i+2]);
+        std::array<float,3> p0 = {x0[0], x0[1], x0[2]};
+        std::array<float,3> p1 = {x1[0], x1[1], x1[2]};
+        std::array<float,3> p2 = {x2[0], x2[1], x2[2]};
+        std::array<float,3> n  = normal(p0,p1,p2);
+        normals[3*i+0] = n[0];
+        normals[3*i+1] = n[1];
+        normals[3*i+2] = n[2];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Mesh::setVertexNormals()
+{
+    PROFILE_SCOPE("setVertexNormals");
+
+    size_t numnodes = getNumNodes();
+    vertexNormals.resize(3*numnodes);
+
+    const int *tri = getTriangles().data();
+    const MeshTopology &topology = getTopology();
+
+    ThreadPool::instance().parallelFor( numnodes, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++) {
+            std::array<float,3> sum = {0.0, 0.0, 0.0};
+            for( int j = topology.nodeFaceOffsets[i]; j < topology.nodeFaceOffsets[i+1]; j++) {
+                const int *t = tri + 3*topology.nodeFaces[j];
+                const float *x0 = getXYZ(t[0]);
+                const float *x1 = getXYZ(t[1]);
+                const float *x2 = getXYZ(t[2]);
+                std::array<float,3> p0 = {x0[0], x0[1], x0[2]};
+                std::array<float,3> p1 = {x1[0], x1[1], x1[2]};
+                std::array<float,3> p2 = {x2[0], x2[1], x2[2]};
+                // The length of the cross product is twice the face area.
+                std::array<float,3> c = cross_product( make_vector(p1,p0), make_vector(p2,p0));
+                sum[0] += c[0];
+                sum[1] += c[1];
+                sum[2] += c[2];
+            }
+            double mag = magnitude(sum);
+            if( mag > 0.0) {
+                sum[0] /= mag;
+                sum[1] /= mag;
+                sum[2] /= mag;
+            }
+            vertexNormals[3*i+0] = sum[0];
+            vertexNormals[3*i+1] = sum[1];
+            vertexNormals[3*i+2] = sum[2];
+        }
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Mesh::saveAs( const std::string &filename)
+{
+    string errmsg;
+    if( saveMesh( filename, *this, errmsg) ) return 1;
+    cout << "Warning: " << errmsg << endl;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
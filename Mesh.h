@@ -0,0 +1,312 @@
+#pragma once
+
+#include <string>
+#include <array>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cassert>
+#include <mutex>
+#include <atomic>
+
+#include "MeshBuffer.h"
+#include "MeshTopology.h"
+#include "ObjectPool.h"
+
+struct Node;
+typedef Node* NodePtr;
+
+struct Edge;
+typedef Edge* EdgePtr;
+
+struct Face;
+typedef Face* FacePtr;
+
+// Node, Edge and Face form an optional pointer-based view of a Mesh. The
+// geometry itself lives in the contiguous Mesh arrays; a Node only points into
+// them, so the view must be rebuilt whenever those arrays are resized. The
+// elements are allocated from pools owned by the Mesh and are released
+// together by Mesh::clearTopology().
+
+struct Node
+{
+    int  id;
+    bool active   = 1;
+    bool boundary = 0;
+    bool visit    = 0;
+    float *xyz    = nullptr;
+    std::vector<EdgePtr> edges;
+    std::vector<FacePtr> faces;
+};
+
+inline double length2( const NodePtr n0, const NodePtr &n1)
+{
+    double dx = n0->xyz[0] - n1->xyz[0];
+    double dy = n0->xyz[1] - n1->xyz[1];
+    double dz = n0->xyz[2] - n1->xyz[2];
+
+    double l2 = dx*dx + dy*dy + dz*dz;
+    return l2;
+}
+
+struct Edge {
+    Edge() {};
+    Edge( const NodePtr &v0, const NodePtr &v1) {
+        nodes[0] = v0;
+        nodes[1] = v1;
+    }
+
+    bool hasNodes( const NodePtr &n0, const NodePtr &n1) const {
+        if( (nodes[0]->id == n0->id) && (nodes[1]->id == n1->id) ) return 1;
+        if( (nodes[0]->id == n1->id) && (nodes[1]->id == n0->id) ) return 1;
+        return 0;
+    }
+
+    bool isBoundary() const {
+        return faces[1] == nullptr;
+    }
+
+    bool active    = 1;
+    bool interface = 0;
+    std::array<NodePtr,2>  nodes    = {nullptr,nullptr};
+    std::array<FacePtr,2>  faces = {nullptr,nullptr};
+};
+
+struct Face {
+    Face() {};
+    Face( NodePtr &v0, NodePtr &v1, NodePtr &v2) {
+        nodes[0] = v0;
+        nodes[1] = v1;
+        nodes[2] = v2;
+    }
+
+    NodePtr getOpposite( const NodePtr &n0, const NodePtr &n1) const
+    {
+        for( int i = 0; i < 3; i++) {
+            if( nodes[i] == n0 && nodes[(i+1)%3] == n1) return nodes[(i+2)%3];
+            if( nodes[i] == n1 && nodes[(i+1)%3] == n0) return nodes[(i+2)%3];
+        }
+        return nullptr;
+    }
+
+    int getPositionOf( const NodePtr &v) const
+    {
+        for( int i = 0; i < 3; i++) {
+            if( nodes[i] == v ) return i;
+        }
+        return -1;
+    }
+
+    float getAngleAt( const NodePtr &v0) const;
+
+    std::array<float,3> getCentroid() const;
+    float getArea() const;
+
+    bool active  = 1;
+    bool visited = 0;
+    int  id;
+    std::array<NodePtr,3> nodes;
+    std::array<EdgePtr,3> edges;
+    float *normal = nullptr;
+};
+
+inline std::array<float,3> Face :: getCentroid() const
+{
+    std::array<float,3> center = {0.0, 0.0, 0.0};
+
+    for( int i = 0; i < 3; i++) {
+        auto p = nodes[i]->xyz;
+        center[0] += p[0];
+        center[1] += p[1];
+        center[2] += p[2];
+    }
+    center[0] /= 3.0;
+    center[1] /= 3.0;
+    center[2] /= 3.0;
+
+    return center;
+}
+
+inline float Face :: getArea() const
+{
+    float len[3];
+
+    for( int i = 0; i < 3; i++) {
+        auto p0 = nodes[(i+1)%3]->xyz;
+        auto p1 = nodes[(i+2)%3]->xyz;
+        float dx = p1[0] - p0[0];
+        float dy = p1[1] - p0[1];
+        float dz = p1[2] - p0[2];
+        len[i]   = sqrt(dx*dx + dy*dy + dz*dz);
+    }
+    float a = len[0];
+    float b = len[1];
+    float c = len[2];
+    float s = (a+b+c)/2.0;
+
+    float ar = sqrt(s*(s-a)*(s-b)*(s-c));
+    return ar;
+}
+
+inline float Face :: getAngleAt( const NodePtr &n0) const
+{
+    int pos = getPositionOf(n0);
+    assert(pos >= 0);
+
+    auto n1 = nodes[(pos+1)%3];
+    auto n2 = nodes[(pos+2)%3];
+
+    double a2 = length2(n1,n2);
+    double b2 = length2(n2,n0);
+    double c2 = length2(n0,n1);
+
+    double cosA = (b2 + c2 - a2) /(2*sqrt(b2*c2));
+    if( cosA > 1.0) cosA =  1.0;
+    if( cosA <-1.0) cosA = -1.0;
+
+    double A  = 180.0*acos( cosA )/M_PI;
+    return A;
+}
+
+template<class T>
+inline double magnitude( const std::array<T,3> &A )
+{
+    return sqrt( A[0]*A[0] + A[1]*A[1] + A[2]*A[2] );
+}
+
+template<class T>
+inline std::array<T,3> make_vector( const std::array<T,3> &head, const std::array<T,3> &tail)
+{
+    std::array<T,3> V;
+    V[0] = head[0] - tail[0];
+    V[1] = head[1] - tail[1];
+    V[2] = head[2] - tail[2];
+    return V;
+}
+
+template<class T>
+inline std::array<T,3> cross_product( const std::array<T,3> &A, const std::array<T,3> &B)
+{
+    std::array<T,3> C;
+    C[0] = A[1]*B[2] - A[2]*B[1];
+    C[1] = A[2]*B[0] - A[0]*B[2];
+    C[2] = A[0]*B[1] - A[1]*B[0];
+    return C;
+}
+
+template<class T>
+inline std::array<T,3> normal( const std::array<T,3> &A, const std::array<T,3> &B, const std::array<T,3> &C)
+{
+    std::array<T,3> BA = make_vector(B,A);
+    std::array<T,3> CA = make_vector(C,A);
+    std::array<T,3> cprod = cross_product(BA, CA);
+    double  mag = magnitude(cprod);
+    cprod[0] /= mag;
+    cprod[1] /= mag;
+    cprod[2] /= mag;
+    return cprod;
+}
+
+// Triangles and adjacency of a mesh. All poses of a mesh share one instance
+// read-only and differ only in their positions and normals.
+struct MeshConnectivity
+{
+    // Triangle vertex indices packed as a0 b0 c0 a1 b1 c1 ...
+    MeshBuffer<int> triangles;
+
+    // Number of vertices the indices refer to.
+    size_t numNodes = 0;
+
+    size_t getNumFaces() const { return triangles.size()/3; }
+
+    // Adjacency tables, built on first use; safe to call from several threads.
+    const MeshTopology &getTopology() const;
+    bool hasTopology() const { return topologyBuilt; }
+
+    // Install tables built elsewhere, e.g. read from a cache, before the
+    // connectivity is shared.
+    void setTopology( MeshTopology &&t);
+
+private:
+    mutable std::mutex        topologyMutex;
+    mutable std::atomic<bool> topologyBuilt{false};
+    mutable MeshTopology      topology;
+};
+
+typedef std::shared_ptr<const MeshConnectivity> ConnectivityPtr;
+
+struct Mesh
+{
+    // Vertex positions packed as x0 y0 z0 x1 y1 z1 ...
+    MeshBuffer<float> coords;
+
+    // One unit normal per triangle, packed like coords.
+    MeshBuffer<float> normals;
+
+    // Optional area-weighted unit normal per vertex, packed like coords.
+    MeshBuffer<float> vertexNormals;
+
+    // Triangles and adjacency, possibly shared with other poses.
+    ConnectivityPtr connectivity = std::make_shared<MeshConnectivity>();
+
+    size_t getNumNodes() const { return coords.size()/3; }
+    size_t getNumFaces() const { return connectivity->getNumFaces(); }
+
+    const MeshBuffer<int> &getTriangles() const { return connectivity->triangles; }
+    const MeshTopology    &getTopology()  const { return connectivity->getTopology(); }
+
+    // Use the connectivity of another pose of the same mesh.
+    void shareConnectivity( const Mesh &m) { connectivity = m.connectivity; }
+
+    float *getXYZ( size_t i) { return &coords[3*i]; }
+    const float *getXYZ( size_t i) const { return &coords[3*i]; }
+
+    // Optional pointer-based view over the arrays above; builds the
+    // adjacency tables first if needed.
+    void buildTopology();
+    void clearTopology();
+
+    EdgePtr addEdge( NodePtr &n0, NodePtr &n1, FacePtr &f);
+    void    addFace( FacePtr &f);
+
+    NodePtr newNode();
+    EdgePtr newEdge( NodePtr &n0, NodePtr &n1);
+    FacePtr newFace( NodePtr &n0, NodePtr &n1, NodePtr &n2);
+
+    std::vector<NodePtr> nodes;
+    std::vector<EdgePtr> edges;
+    std::vector<FacePtr> faces;
+
+    ObjectPool<Node> nodePool;
+    ObjectPool<Edge> edgePool;
+    ObjectPool<Face> facePool;
+
+    // Recompute all face normals; runs on ThreadPool::instance().
+    void setSurfaceNormals();
+    void setSurfaceNormals( size_t begin, size_t end);
+
+    // Compute vertexNormals by summing the area-weighted normals of the
+    // faces around each vertex; uses the adjacency tables.
+    void setVertexNormals();
+
+    double radius;
+
+    // Write the mesh in the format of the extension of s; see saveMesh().
+    bool saveAs( const std::string &s);
+    std::array<double,3> center = {0.0, 0.0, 0.0};
+};
+
+inline NodePtr Mesh::newNode()
+{
+    return nodePool.newObject();
+}
+
+inline EdgePtr Mesh::newEdge( NodePtr &n0, NodePtr &n1)
+{
+    return edgePool.newObject(n0,n1);
+}
+
+inline FacePtr Mesh::newFace( NodePtr &n0, NodePtr &n1, NodePtr &n2)
+{
+    return facePool.newObject(n0,n1,n2);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+
+#include "Profile.h"
+
+class MappedFile;
+
+// Array used for the Mesh geometry. It either owns its elements like a
+// std::vector, or is a view into a memory-mapped file that it keeps alive.
+// Mapped buffers are private copy-on-write mappings, so writing to them is
+// allowed and never changes the file. Resizing a mapped buffer or copying
+// any buffer produces an owned array.
+
+template<class T>
+class MeshBuffer
+{
+public:
+    MeshBuffer() {}
+    MeshBuffer( const MeshBuffer &b) { *this = b; }
+    MeshBuffer( MeshBuffer &&b) noexcept { *this = std::move(b); }
+
+    MeshBuffer &operator=( const MeshBuffer &b) {
+        if( this == &b) return *this;
+        if( b.size() > owned.capacity() ) PROFILE_COUNT("buffers allocated", 1);
+        owned.assign(b.begin(), b.end());
+        file.reset();
+        ptr   = owned.data();
+        count = owned.size();
+        return *this;
+    }
+
+    MeshBuffer &operator=( MeshBuffer &&b) noexcept {
+        if( this == &b) return *this;
+        owned = std::move(b.owned);
+        file  = std::move(b.file);
+        ptr   = file ? b.ptr : owned.data();
+        count = b.count;
+        b.ptr   = nullptr;
+        b.count = 0;
+        return *this;
+    }
+
+    MeshBuffer &operator=( const std::vector<T> &v) {
+        owned = v;
+        file.reset();
+        ptr   = owned.data();
+        count = owned.size();
+        return *this;
+    }
+
+    // Refer to n elements at p inside a mapping owned by f.
+    void setMapped( const std::shared_ptr<MappedFile> &f, T *p, size_t n) {
+        owned.clear();
+        owned.shrink_to_fit();
+        file  = f;
+        ptr   = p;
+        count = n;
+    }
+
+    bool isMapped() const { return file != nullptr; }
+
+    void resize( size_t n) {
+        if( n > owned.capacity() ) PROFILE_COUNT("buffers allocated", 1);
+        if( isMapped() ) {
+            if( n == count) return;
+            owned.assign(ptr, ptr + std::min(n, count));
+            file.reset();
+        }
+        owned.resize(n);
+        ptr   = owned.data();
+        count = owned.size();
+    }
+
+    void clear() { resize(0); }
+
+    size_t size()  const { return count; }
+    bool   empty() const { return count == 0; }
+
+    T *data() { return ptr; }
+    const T *data() const { return ptr; }
+
+    T &operator[]( size_t i) { return ptr[i]; }
+    const T &operator[]( size_t i) const { return ptr[i]; }
+
+    T *begin() { return ptr; }
+    T *end()   { return ptr + count; }
+    const T *begin() const { return ptr; }
+    const T *end()   const { return ptr + count; }
+
+private:
+    std::vector<T> owned;
+    std::shared_ptr<MappedFile> file;
+    T      *ptr   = nullptr;
+    size_t  count = 0;
+};
@@ -0,0 +1,951 @@
+#include "MeshIO.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+// Bytes of input handed to one task while scanning an OFF file.
+const size_t PARSE_CHUNK = 1 << 20;
+
+const char   CACHE_MAGIC[8]   = "SAMMESH";
+const uint32_t CACHE_BYTEORDER  = 0x01020304;
+const size_t   CACHE_ALIGNMENT  = 64;
+
+enum CacheSectionTag {
+    SECTION_POSITIONS         = 1,
+    SECTION_TRIANGLES         = 2,
+    SECTION_FACE_NORMALS      = 3,
+    SECTION_EDGE_NODES        = 4,
+    SECTION_EDGE_FACE_OFFSETS = 5,
+    SECTION_EDGE_FACES        = 6,
+    SECTION_FACE_EDGES        = 7,
+    SECTION_NODE_FACE_OFFSETS = 8,
+    SECTION_NODE_FACES        = 9,
+    SECTION_NODE_EDGE_OFFSETS = 10,
+    SECTION_NODE_EDGES        = 11,
+    SECTION_BOUNDARY_EDGES    = 12,
+    SECTION_NONMANIFOLD_EDGES = 13
+};
+
+// Topology tables in the order of their section tags.
+template<class Topology>
+auto getTopologyTables( Topology &t)
+{
+    return std::array<decltype(&t.edgeNodes),10> {
+        &t.edgeNodes, &t.edgeFaceOffsets, &t.edgeFaces, &t.faceEdges,
+        &t.nodeFaceOffsets, &t.nodeFaces, &t.nodeEdgeOffsets, &t.nodeEdges,
+        &t.boundaryEdges, &t.nonManifoldEdges };
+}
+
+struct CacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint64_t numNodes;
+    uint64_t numFaces;
+    uint32_t numSections;
+    uint32_t reserved;
+};
+
+struct CacheSection
+{
+    uint32_t tag;
+    uint32_t elemSize;
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct ParseChunk
+{
+    const char *begin, *end;
+    size_t numLines  = 0;     // physical lines starting in the chunk
+    size_t numData   = 0;     // lines that are neither blank nor comments
+    size_t firstLine = 0;     // 1-based line number of the first line
+    size_t firstData = 0;     // index of the first data line in the section
+    size_t errorLine = 0;
+    string error;
+};
+
+inline bool isBlank( char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char *skipBlanks( const char *p, const char *end)
+{
+    while( p < end && isBlank(*p)) p++;
+    return p;
+}
+
+inline const char *endOfLine( const char *p, const char *end)
+{
+    const char *q = static_cast<const char*>(memchr(p, '\n', end - p));
+    return q ? q : end;
+}
+
+inline bool isDataLine( const char *p, const char *eol)
+{
+    p = skipBlanks(p, eol);
+    return p < eol && *p != '#';
+}
+
+template<class T>
+inline bool parseValue( const char *&p, const char *eol, T &val)
+{
+    p = skipBlanks(p, eol);
+    auto res = from_chars(p, eol, val);
+    if( res.ec != errc() ) return 0;
+    p = res.ptr;
+    return p == eol || isBlank(*p) || *p == '#';
+}
+
+// Next whitespace separated token of the header, skipping comments.
+inline bool nextToken( const char *&p, const char *end, size_t &line, const char *&tok, const char *&tokEnd)
+{
+    while( p < end) {
+        if( *p == '\n') {
+            line++;
+            p++;
+        } else if( isBlank(*p)) {
+            p++;
+        } else if( *p == '#') {
+            p = endOfLine(p, end);
+        } else {
+            break;
+        }
+    }
+    if( p == end) return 0;
+    tok = p;
+    while( p < end && !isBlank(*p) && *p != '\n' && *p != '#') p++;
+    tokEnd = p;
+    return 1;
+}
+
+void countLines( ParseChunk &chunk)
+{
+    const char *p = chunk.begin;
+    while( p < chunk.end) {
+        const char *eol = endOfLine(p, chunk.end);
+        if( isDataLine(p, eol)) chunk.numData++;
+        chunk.numLines++;
+        p = eol + 1;
+    }
+}
+
+void parseLines( ParseChunk &chunk, size_t numNodes, size_t numFaces, float *coords, int *tri)
+{
+
+    size_t line = chunk.firstLine;
+    size_t k    = chunk.firstData;
+    const char *p = chunk.begin;
+
+    for( ; p < chunk.end && k < numNodes + numFaces; line++) {
+        const char *eol = endOfLine(p, chunk.end);
+        if( !isDataLine(p, eol)) {
+            p = eol + 1;
+            continue;
+        }
+
+        if( k < numNodes) {
+            double x, y, z;
+            if( !parseValue(p, eol, x) || !parseValue(p, eol, y) || !parseValue(p, eol, z)) {
+                chunk.error = "invalid vertex coordinates";
+                break;
+            }
+            coords[3*k+0] = x;
+            coords[3*k+1] = y;
+            coords[3*k+2] = z;
+        } else {
+            size_t f = k - numNodes;
+            int nsides, v[3];
+            if( !parseValue(p, eol, nsides)) {
+                chunk.error = "invalid face";
+                break;
+            }
+            if( nsides != 3) {
+                chunk.error = "face with " + to_string(nsides) + " vertices; only triangles are supported";
+                break;
+            }
+            if( !parseValue(p, eol, v[0]) || !parseValue(p, eol, v[1]) || !parseValue(p, eol, v[2])) {
+                chunk.error = "invalid face";
+                break;
+            }
+            for( int j = 0; j < 3; j++) {
+                if( v[j] < 0 || (size_t)v[j] >= numNodes) {
+                    chunk.error = "vertex index " + to_string(v[j]) + " out of range";
+                    break;
+                }
+                tri[3*f+j] = v[j];
+            }
+            if( !chunk.error.empty() ) break;
+        }
+        k++;
+        p = eol + 1;
+    }
+
+    if( !chunk.error.empty() ) chunk.errorLine = line;
+}
+
+bool getSourceStamp( const string &filename, uint64_t &size, int64_t &mtime)
+{
+    struct stat st;
+    if( stat(filename.c_str(), &st) != 0) return 0;
+    size  = st.st_size;
+    mtime = int64_t(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec;
+    return 1;
+}
+
+// Scalar types of PLY properties.
+enum PlyType {
+    PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+PlyType getPlyType( const string &s)
+{
+    if( s == "char"   || s == "int8")    return PLY_INT8;
+    if( s == "uchar"  || s == "uint8")   return PLY_UINT8;
+    if( s == "short"  || s == "int16")   return PLY_INT16;
+    if( s == "ushort" || s == "uint16")  return PLY_UINT16;
+    if( s == "int"    || s == "int32")   return PLY_INT32;
+    if( s == "uint"   || s == "uint32")  return PLY_UINT32;
+    if( s == "float"  || s == "float32") return PLY_FLOAT32;
+    if( s == "double" || s == "float64") return PLY_FLOAT64;
+    return PLY_NONE;
+}
+
+inline size_t getPlySize( PlyType t)
+{
+    static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[t];
+}
+
+inline bool isPlyInteger( PlyType t)
+{
+    return t >= PLY_INT8 && t <= PLY_UINT32;
+}
+
+// Value of type t at p, byte swapped if the file is in the other byte order.
+template<class T, class U>
+inline T loadPly( const char *p, bool swap)
+{
+    U bits;
+    memcpy(&bits, p, sizeof(bits));
+    if( swap) {
+        if( sizeof(bits) == 2) bits = __builtin_bswap16(bits);
+        if( sizeof(bits) == 4) bits = __builtin_bswap32(bits);
+        if( sizeof(bits) == 8) bits = __builtin_bswap64(bits);
+    }
+    T val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+inline double readPlyValue( const char *p, PlyType t, bool swap)
+{
+    switch( t ) {
+    case PLY_INT8:    return static_cast<int8_t>(*p);
+    case PLY_UINT8:   return static_cast<uint8_t>(*p);
+    case PLY_INT16:   return loadPly<int16_t, uint16_t>(p, swap);
+    case PLY_UINT16:  return loadPly<uint16_t, uint16_t>(p, swap);
+    case PLY_INT32:   return loadPly<int32_t, uint32_t>(p, swap);
+    case PLY_UINT32:  return loadPly<uint32_t, uint32_t>(p, swap);
+    case PLY_FLOAT32: return loadPly<float, uint32_t>(p, swap);
+    case PLY_FLOAT64: return loadPly<double, uint64_t>(p, swap);
+    default:          return 0.0;
+    }
+}
+
+inline int64_t readPlyIndex( const char *p, PlyType t, bool swap)
+{
+    switch( t ) {
+    case PLY_INT8:    return static_cast<int8_t>(*p);
+    case PLY_UINT8:   return static_cast<uint8_t>(*p);
+    case PLY_INT16:   return loadPly<int16_t, uint16_t>(p, swap);
+    case PLY_UINT16:  return loadPly<uint16_t, uint16_t>(p, swap);
+    case PLY_INT32:   return loadPly<int32_t, uint32_t>(p, swap);
+    case PLY_UINT32:  return loadPly<uint32_t, uint32_t>(p, swap);
+    default:          return -1;
+    }
+}
+
+struct PlyProperty
+{
+    string  name;
+    PlyType type      = PLY_NONE;
+    PlyType countType = PLY_NONE;    // set for a list of values of type
+    size_t  offset    = 0;           // within an element whose lists are all triangles
+};
+
+struct PlyElement
+{
+    string name;
+    size_t count = 0;
+    vector<PlyProperty> props;
+    size_t stride = 0;               // size of an element, taking lists to have 3 values
+    bool   hasLists = 0;
+
+    const PlyProperty *find( const string &s) const {
+        for( auto &p : props)
+            if( p.name == s) return &p;
+        return nullptr;
+    }
+};
+
+// Size of the element at p, walking its lists.
+size_t getPlyElementSize( const PlyElement &e, const char *p, const char *end, bool swap)
+{
+    size_t size = 0;
+    for( auto &prop : e.props) {
+        if( prop.countType == PLY_NONE) {
+            size += getPlySize(prop.type);
+            continue;
+        }
+        if( p + size + getPlySize(prop.countType) > end) return end - p + 1;
+        int64_t n = readPlyIndex(p + size, prop.countType, swap);
+        size += getPlySize(prop.countType) + max<int64_t>(n, 0)*getPlySize(prop.type);
+    }
+    return size;
+}
+
+// Lower a shared minimum from several threads.
+inline void lowerTo( atomic<size_t> &m, size_t v)
+{
+    size_t curr = m.load();
+    while( v < curr && !m.compare_exchange_weak(curr, v)) {}
+}
+
+// First face with a vertex index outside [0, numNodes), or SIZE_MAX.
+size_t findBadFace( const int *tri, size_t numFaces, size_t numNodes)
+{
+    atomic<size_t> badFace( SIZE_MAX);
+    ThreadPool::instance().parallelFor( numFaces, FACE_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t f = begin; f < end; f++)
+            for( int j = 0; j < 3; j++)
+                if( tri[3*f+j] < 0 || (size_t)tri[3*f+j] >= numNodes) lowerTo(badFace, f);
+    });
+    return badFace.load();
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool readOFF( const string &filename, Mesh &mesh, string &errmsg)
+{
+    PROFILE_SCOPE("readOFF");
+
+    MappedFile file;
+    if( !file.open(filename)) {
+        errmsg = filename + ": cannot open file";
+        return 0;
+    }
+
+    const char *p   = file.data();
+    const char *end = p + file.size();
+    size_t line = 1;
+
+    const char *tok, *tokEnd;
+    if( !nextToken(p, end, line, tok, tokEnd) || string(tok, tokEnd) != "OFF") {
+        errmsg = filename + ":" + to_string(line) + ": not in OFF format";
+        return 0;
+    }
+
+    size_t counts[3];
+    for( int i = 0; i < 3; i++) {
+        if( !nextToken(p, end, line, tok, tokEnd) ||
+            from_chars(tok, tokEnd, counts[i]).ptr != tokEnd) {
+            errmsg = filename + ":" + to_string(line) + ": invalid OFF header";
+            return 0;
+        }
+    }
+    size_t numNodes = counts[0];
+    size_t numFaces = counts[1];
+
+    // The data section starts on the line after the counts.
+    p = endOfLine(p, end);
+    if( p < end) p++;
+    line++;
+
+    // Split the data section at line boundaries.
+    vector<ParseChunk> chunks;
+    while( p < end) {
+        ParseChunk chunk;
+        chunk.begin = p;
+        chunk.end   = end;
+        if( size_t(end - p) > PARSE_CHUNK) {
+            chunk.end = endOfLine(p + PARSE_CHUNK, end);
+            if( chunk.end < end) chunk.end++;
+        }
+        chunks.push_back(chunk);
+        p = chunk.end;
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallelFor( chunks.size(), 1, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++) countLines(chunks[i]);
+    });
+
+    size_t numData = 0;
+    for( auto &chunk : chunks) {
+        chunk.firstLine = line;
+        chunk.firstData = numData;
+        line    += chunk.numLines;
+        numData += chunk.numData;
+    }
+
+    if( numData < numNodes + numFaces) {
+        errmsg = filename + ":" + to_string(line) + ": unexpected end of file, expected "
+                 + to_string(numNodes) + " vertices and " + to_string(numFaces) + " faces";
+        return 0;
+    }
+
+    MeshBuffer<float> coords;
+    coords.resize(3*numNodes);
+
+    auto conn = make_shared<MeshConnectivity>();
+    conn->numNodes = numNodes;
+    conn->triangles.resize(3*numFaces);
+
+    pool.parallelFor( chunks.size(), 1, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++)
+            parseLines(chunks[i], numNodes, numFaces, coords.data(), conn->triangles.data());
+    });
+
+    for( auto &chunk : chunks) {
+        if( !chunk.error.empty() ) {
+            errmsg = filename + ":" + to_string(chunk.errorLine) + ": " + chunk.error;
+            return 0;
+        }
+    }
+
+    mesh.clearTopology();
+    mesh.normals.clear();
+    mesh.coords       = std::move(coords);
+    mesh.connectivity = conn;
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool readPLY( const string &filename, Mesh &mesh, string &errmsg)
+{
+    PROFILE_SCOPE("readPLY");
+
+    auto file = make_shared<MappedFile>();
+    if( !file->open(filename, 1)) {
+        errmsg = filename + ": cannot open file";
+        return 0;
+    }
+
+    char       *data = file->data();
+    const char *end  = data + file->size();
+
+    const uint16_t probe = 1;
+    bool hostLittle = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+
+    // The header has one keyword per line up to end_header.
+    const char *p = data;
+    size_t line = 0;
+    bool   binary = 0, swap = 0, ended = 0;
+    vector<PlyElement> elements;
+    auto fail = [&](const string &reason) {
+        errmsg = filename + ":" + to_string(line) + ": " + reason;
+        return 0;
+    };
+
+    while( p < end && !ended) {
+        const char *eol = endOfLine(p, end);
+        string text(p, eol);
+        if( !text.empty() && text.back() == '\r') text.pop_back();
+        p = eol < end ? eol + 1 : end;
+        line++;
+
+        istringstream in(text);
+        string key;
+        in >> key;
+
+        if( line == 1) {
+            if( key != "ply") return fail("not in PLY format");
+        } else if( key == "format") {
+            string format;
+            in >> format;
+            if( format == "ascii") return fail("ASCII PLY is not supported");
+            if( format != "binary_little_endian" && format != "binary_big_endian")
+                return fail("unknown format " + format);
+            binary = 1;
+            swap   = (format == "binary_little_endian") != hostLittle;
+        } else if( key == "element") {
+            PlyElement e;
+            in >> e.name >> e.count;
+            if( in.fail() ) return fail("invalid element");
+            elements.push_back(e);
+        } else if( key == "property") {
+            if( elements.empty() ) return fail("property outside an element");
+            PlyProperty prop;
+            string type;
+            in >> type;
+            if( type == "list") {
+                string countType, itemType;
+                in >> countType >> itemType;
+                prop.countType = getPlyType(countType);
+                prop.type      = getPlyType(itemType);
+                if( !isPlyInteger(prop.countType) || prop.type == PLY_NONE) return fail("invalid list property");
+            } else {
+                prop.type = getPlyType(type);
+                if( prop.type == PLY_NONE) return fail("unknown type " + type);
+            }
+            in >> prop.name;
+            if( in.fail() ) return fail("invalid property");
+
+            PlyElement &e = elements.back();
+            prop.offset = e.stride;
+            if( prop.countType == PLY_NONE) {
+                e.stride += getPlySize(prop.type);
+            } else {
+                e.stride  += getPlySize(prop.countType) + 3*getPlySize(prop.type);
+                e.hasLists = 1;
+            }
+            e.props.push_back(prop);
+        } else if( key == "end_header") {
+            ended = 1;
+        } else if( key != "comment" && key != "obj_info" && !key.empty()) {
+            return fail("unknown keyword " + key);
+        }
+    }
+
+    if( !ended)  return fail("missing end_header");
+    if( !binary) return fail("missing format");
+
+    // Find the vertex and face data. Faces are taken to be triangles here and
+    // checked when they are read; other elements with lists are walked.
+    const PlyElement *vertex = nullptr, *face = nullptr;
+    const char *vertexData = nullptr, *faceData = nullptr;
+    for( const PlyElement &e : elements) {
+        if( e.name == "vertex") {
+            vertex     = &e;
+            vertexData = p;
+        } else if( e.name == "face") {
+            face     = &e;
+            faceData = p;
+        }
+
+        if( !e.hasLists || &e == face) {
+            if( e.stride > 0 && e.count > size_t(end - p)/e.stride) {
+                errmsg = filename + ": " + e.name + " element " +
+                         (&e == face ? "truncated or not all triangles" : "truncated");
+                return 0;
+            }
+            p += e.count*e.stride;
+        } else {
+            for( size_t i = 0; i < e.count; i++) {
+                size_t size = getPlyElementSize(e, p, end, swap);
+                if( size > size_t(end - p)) {
+                    errmsg = filename + ": " + e.name + " element truncated";
+                    return 0;
+                }
+                p += size;
+            }
+        }
+    }
+
+    const PlyProperty *px = vertex ? vertex->find("x") : nullptr;
+    const PlyProperty *py = vertex ? vertex->find("y") : nullptr;
+    const PlyProperty *pz = vertex ? vertex->find("z") : nullptr;
+    if( !px || !py || !pz || px->countType || py->countType || pz->countType) {
+        errmsg = filename + ": no vertex element with properties x, y and z";
+        return 0;
+    }
+    if( vertex->hasLists) {
+        errmsg = filename + ": list properties of vertices are not supported";
+        return 0;
+    }
+
+    // A face element holds one list of indices or three scalar ones.
+    const PlyProperty *list = nullptr, *index[3] = { nullptr, nullptr, nullptr };
+    if( face) {
+        list = face->find("vertex_indices");
+        if( !list) list = face->find("vertex_index");
+        size_t numLists = 0, numIndices = 0;
+        for( auto &prop : face->props) {
+            if( prop.countType != PLY_NONE) numLists++;
+            else if( isPlyInteger(prop.type) && numIndices < 3) index[numIndices++] = &prop;
+        }
+        bool listOK    = list && list->countType != PLY_NONE && isPlyInteger(list->type) && numLists == 1;
+        bool scalarsOK = !list && numLists == 0 && numIndices == 3;
+        if( !listOK && !scalarsOK) {
+            errmsg = filename + ": face element without a list of vertex indices";
+            return 0;
+        }
+        if( !listOK) list = nullptr;
+    }
+
+    size_t numNodes = vertex->count;
+    size_t numFaces = face ? face->count : 0;
+    ThreadPool &pool = ThreadPool::instance();
+
+    // Native floats x, y, z are mapped as they are.
+    MeshBuffer<float> coords;
+    bool mapCoords = !swap && vertex->props.size() == 3 && vertex->stride == 3*sizeof(float) &&
+                     px->type == PLY_FLOAT32 && py->type == PLY_FLOAT32 && pz->type == PLY_FLOAT32 &&
+                     px->offset == 0 && py->offset == 4 && pz->offset == 8 &&
+                     (vertexData - data) % alignof(float) == 0;
+    if( mapCoords) {
+        coords.setMapped( file, reinterpret_cast<float*>(data + (vertexData - data)), 3*numNodes);
+    } else {
+        coords.resize(3*numNodes);
+        float *xyz = coords.data();
+        size_t stride = vertex->stride;
+        pool.parallelFor( numNodes, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+            for( size_t i = begin; i < end; i++) {
+                const char *q = vertexData + i*stride;
+                xyz[3*i+0] = readPlyValue(q + px->offset, px->type, swap);
+                xyz[3*i+1] = readPlyValue(q + py->offset, py->type, swap);
+                xyz[3*i+2] = readPlyValue(q + pz->offset, pz->type, swap);
+            }
+        });
+    }
+
+    auto conn = make_shared<MeshConnectivity>();
+    conn->numNodes = numNodes;
+
+    // Likewise three native ints per face; lists always need converting.
+    atomic<size_t> badFace( SIZE_MAX);
+    bool mapTriangles = face && !list && !swap && face->props.size() == 3 && face->stride == 3*sizeof(int) &&
+                        index[0]->offset == 0 && index[1]->offset == 4 && index[2]->offset == 8 &&
+                        (index[0]->type == PLY_INT32 || index[0]->type == PLY_UINT32) &&
+                        index[1]->type == index[0]->type && index[2]->type == index[0]->type &&
+                        (faceData - data) % alignof(int) == 0;
+    if( mapTriangles) {
+        conn->triangles.setMapped( file, reinterpret_cast<int*>(data + (faceData - data)), 3*numFaces);
+        badFace = findBadFace( conn->triangles.data(), numFaces, numNodes);
+    } else if( face) {
+        conn->triangles.resize(3*numFaces);
+        int   *tri    = conn->triangles.data();
+        size_t stride = face->stride;
+
+        // The usual uchar counts and native ints are copied without conversion.
+        bool packed = list && !swap && getPlySize(list->countType) == 1 &&
+                      (list->type == PLY_INT32 || list->type == PLY_UINT32);
+
+        pool.parallelFor( numFaces, FACE_CHUNK, [&](size_t begin, size_t end) {
+            for( size_t f = begin; packed && f < end; f++) {
+                const char *q = faceData + f*stride + list->offset;
+                int v[3];
+                memcpy(v, q + 1, sizeof(v));
+                if( *q != 3 || (unsigned)v[0] >= numNodes || (unsigned)v[1] >= numNodes ||
+                    (unsigned)v[2] >= numNodes)
+                    lowerTo(badFace, f);
+                memcpy(tri + 3*f, v, sizeof(v));
+            }
+
+            for( size_t f = begin; !packed && f < end; f++) {
+                const char *q = faceData + f*stride;
+                int64_t v[3];
+                if( list) {
+                    q += list->offset;
+                    if( readPlyIndex(q, list->countType, swap) != 3) {
+                        lowerTo(badFace, f);
+                        continue;
+                    }
+                    q += getPlySize(list->countType);
+                    for( int j = 0; j < 3; j++)
+                        v[j] = readPlyIndex(q + j*getPlySize(list->type), list->type, swap);
+                } else {
+                    for( int j = 0; j < 3; j++)
+                        v[j] = readPlyIndex(q + index[j]->offset, index[j]->type, swap);
+                }
+                for( int j = 0; j < 3; j++) {
+                    if( v[j] < 0 || (uint64_t)v[j] >= numNodes) lowerTo(badFace, f);
+                    tri[3*f+j] = v[j];
+                }
+            }
+        });
+    }
+
+    // Faces before the first bad one were all triangles, so it was read at
+    // the right place.
+    size_t f = badFace.load();
+    if( f != SIZE_MAX) {
+        int64_t n = list ? readPlyIndex(faceData + f*face->stride + list->offset, list->countType, swap) : 3;
+        if( n != 3)
+            errmsg = filename + ": face " + to_string(f) + " with " + to_string(n) +
+                     " vertices; only triangles are supported";
+        else
+            errmsg = filename + ": face " + to_string(f) + " has a vertex index out of range";
+        return 0;
+    }
+
+    mesh.clearTopology();
+    mesh.normals.clear();
+    mesh.coords       = std::move(coords);
+    mesh.connectivity = conn;
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool writeMeshCache( const string &filename, const Mesh &mesh, string &errmsg, const string &source,
+                     const vector<CacheExtra> &extra)
+{
+    PROFILE_SCOPE("writeMeshCache");
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version   = MESH_CACHE_VERSION;
+    header.byteOrder = CACHE_BYTEORDER;
+    header.numNodes  = mesh.getNumNodes();
+    header.numFaces  = mesh.getNumFaces();
+
+    if( !source.empty() && !getSourceStamp(source, header.sourceSize, header.sourceTime)) {
+        errmsg = source + ": cannot stat file";
+        return 0;
+    }
+
+    struct Array {
+        uint32_t tag;
+        const void *data;
+        uint64_t count;
+        uint32_t elemSize;
+    };
+    vector<Array> arrays;
+    arrays.push_back( {SECTION_POSITIONS, mesh.coords.data(),    mesh.coords.size(), 4} );
+    arrays.push_back( {SECTION_TRIANGLES, mesh.getTriangles().data(), mesh.getTriangles().size(), 4} );
+    if( mesh.normals.size() == 3*mesh.getNumFaces() )
+        arrays.push_back( {SECTION_FACE_NORMALS, mesh.normals.data(), mesh.normals.size(), 4} );
+
+    if( mesh.connectivity->hasTopology() ) {
+        uint32_t tag = SECTION_EDGE_NODES;
+        for( auto table : getTopologyTables(mesh.getTopology()))
+            arrays.push_back( {tag++, table->data(), table->size(), 4} );
+    }
+
+    for( const CacheExtra &e : extra)
+        arrays.push_back( {e.tag, e.data->data(), e.data->size(), sizeof(double)} );
+
+    header.numSections = arrays.size();
+
+    vector<CacheSection> sections(arrays.size());
+    uint64_t offset = sizeof(CacheHeader) + sections.size()*sizeof(CacheSection);
+    for( size_t i = 0; i < arrays.size(); i++) {
+        offset = (offset + CACHE_ALIGNMENT - 1)/CACHE_ALIGNMENT*CACHE_ALIGNMENT;
+        sections[i].tag      = arrays[i].tag;
+        sections[i].elemSize = arrays[i].elemSize;
+        sections[i].offset   = offset;
+        sections[i].count    = arrays[i].count;
+        offset += arrays[i].count*arrays[i].elemSize;
+    }
+
+    string tmpname = filename + ".tmp";
+    ofstream ofile(tmpname.c_str(), ios::out | ios::binary);
+    if( ofile.fail() ) {
+        errmsg = tmpname + ": cannot create file";
+        return 0;
+    }
+
+    ofile.write( reinterpret_cast<const char*>(&header), sizeof(header));
+    ofile.write( reinterpret_cast<const char*>(sections.data()), sections.size()*sizeof(CacheSection));
+
+    const char zeros[CACHE_ALIGNMENT] = {0};
+    for( size_t i = 0; i < arrays.size(); i++) {
+        ofile.write( zeros, sections[i].offset - ofile.tellp());
+        ofile.write( static_cast<const char*>(arrays[i].data), arrays[i].count*arrays[i].elemSize);
+    }
+    ofile.close();
+
+    if( ofile.fail() || rename(tmpname.c_str(), filename.c_str()) != 0) {
+        remove(tmpname.c_str());
+        errmsg = filename + ": cannot write file";
+        return 0;
+    }
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool readMeshCache( const string &filename, Mesh &mesh, string &errmsg, const string &source,
+                    const vector<CacheExtraMap> &extra)
+{
+    PROFILE_SCOPE("readMeshCache");
+
+    auto file = make_shared<MappedFile>();
+    if( !file->open(filename, 1)) {
+        errmsg = filename + ": cannot open file";
+        return 0;
+    }
+
+    CacheHeader header;
+    if( file->size() < sizeof(header)) {
+        errmsg = filename + ": not a mesh cache";
+        return 0;
+    }
+    memcpy(&header, file->data(), sizeof(header));
+
+    if( memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byteOrder != CACHE_BYTEORDER) {
+        errmsg = filename + ": not a mesh cache";
+        return 0;
+    }
+    if( header.version != MESH_CACHE_VERSION) {
+        errmsg = filename + ": unsupported mesh cache version " + to_string(header.version);
+        return 0;
+    }
+
+    if( !source.empty() ) {
+        uint64_t size;
+        int64_t  mtime;
+        if( !getSourceStamp(source, size, mtime) ||
+            size != header.sourceSize || mtime != header.sourceTime) {
+            errmsg = filename + ": out of date with " + source;
+            return 0;
+        }
+    }
+
+    // Every vertex and face takes at least one byte, which also keeps the
+    // section counts below from wrapping around.
+    uint64_t tableEnd = sizeof(header) + uint64_t(header.numSections)*sizeof(CacheSection);
+    if( tableEnd > file->size() || header.numNodes > file->size() || header.numFaces > file->size() ) {
+        errmsg = filename + ": truncated mesh cache";
+        return 0;
+    }
+
+    const CacheSection *sections = reinterpret_cast<const CacheSection*>(file->data() + sizeof(header));
+
+    MeshBuffer<float> coords, normals;
+    MeshTopology      topology;
+    auto conn = make_shared<MeshConnectivity>();
+    conn->numNodes = header.numNodes;
+
+    vector<MeshBuffer<double>> extraData( extra.size() );
+
+    bool hasCoords = 0, hasTriangles = 0;
+    for( uint32_t i = 0; i < header.numSections; i++) {
+        CacheSection s = sections[i];
+        bool extraTag  = s.tag >= FIRST_EXTRA_SECTION;
+        if( s.elemSize != (extraTag ? sizeof(double) : 4) || s.offset % s.elemSize != 0 ||
+            s.offset > file->size() || s.count > (file->size() - s.offset)/s.elemSize) {
+            errmsg = filename + ": corrupt section " + to_string(i);
+            return 0;
+        }
+        char *ptr = file->data() + s.offset;
+
+        if( extraTag) {
+            for( size_t j = 0; j < extra.size(); j++)
+                if( extra[j].tag == s.tag)
+                    extraData[j].setMapped( file, reinterpret_cast<double*>(ptr), s.count);
+            continue;
+        }
+
+        switch( s.tag ) {
+        case SECTION_POSITIONS:
+            if( s.count != 3*header.numNodes) break;
+            coords.setMapped( file, reinterpret_cast<float*>(ptr), s.count);
+            hasCoords = 1;
+            break;
+        case SECTION_TRIANGLES:
+            if( s.count != 3*header.numFaces) break;
+            conn->triangles.setMapped( file, reinterpret_cast<int*>(ptr), s.count);
+            hasTriangles = 1;
+            break;
+        case SECTION_FACE_NORMALS:
+            if( s.count != 3*header.numFaces) break;
+            normals.setMapped( file, reinterpret_cast<float*>(ptr), s.count);
+            break;
+        default:
+            if( s.tag >= SECTION_EDGE_NODES && s.tag <= SECTION_NONMANIFOLD_EDGES) {
+                auto tables = getTopologyTables(topology);
+                tables[s.tag - SECTION_EDGE_NODES]->setMapped( file, reinterpret_cast<int*>(ptr), s.count);
+            }
+            break;
+        }
+    }
+
+    if( !hasCoords || !hasTriangles) {
+        errmsg = filename + ": mesh cache without positions or triangles";
+        return 0;
+    }
+
+    // The file may come from elsewhere, so no index is used unchecked.
+    size_t badFace = findBadFace( conn->triangles.data(), header.numFaces, header.numNodes);
+    if( badFace != SIZE_MAX) {
+        errmsg = filename + ": face " + to_string(badFace) + " has a vertex index out of range";
+        return 0;
+    }
+
+    if( !topology.empty() ) {
+        if( !topology.isConsistent(header.numFaces, header.numNodes)) {
+            errmsg = filename + ": corrupt topology tables";
+            return 0;
+        }
+        conn->setTopology( std::move(topology));
+    }
+
+    mesh.clearTopology();
+    mesh.coords       = std::move(coords);
+    mesh.normals      = std::move(normals);
+    mesh.connectivity = conn;
+
+    for( size_t j = 0; j < extra.size(); j++)
+        *extra[j].data = std::move(extraData[j]);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+string getMeshCacheName( const string &filename)
+{
+    return filename + ".bmesh";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool loadMesh( const string &filename, Mesh &mesh, string &errmsg, bool useCache, bool withTopology)
+{
+    size_t dot = filename.rfind('.');
+    string ext = dot == string::npos ? "" : filename.substr(dot);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    if( ext == ".ply") {
+        if( !readPLY(filename, mesh, errmsg)) return 0;
+        mesh.setSurfaceNormals();
+        if( withTopology) mesh.getTopology();
+        return 1;
+    }
+
+    string cachename = getMeshCacheName(filename);
+    string cacheerr;
+
+    if( useCache && readMeshCache(cachename, mesh, cacheerr, filename)) {
+        if( !withTopology || mesh.connectivity->hasTopology() ) return 1;
+    } else {
+        if( !readOFF(filename, mesh, errmsg)) return 0;
+        mesh.setSurfaceNormals();
+    }
+
+    // The cache is written once the tables exist, so that they are stored
+    // with the mesh.
+    if( withTopology) mesh.getTopology();
+    if( useCache ) writeMeshCache(cachename, mesh, cacheerr, filename);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
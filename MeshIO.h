@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Mesh.h"
+
+// Read a triangle mesh in OFF format into mesh.coords and mesh.triangles.
+// The file is memory mapped and its vertex and face lines are parsed in
+// parallel on ThreadPool::instance(). Each vertex and each face must be on a
+// line of its own; blank lines and '#' comments are skipped and values after
+// the expected ones on a line are ignored.
+//
+// Returns false and a message of the form "file:line: reason" in errmsg when
+// the file cannot be read, is malformed, or contains a non-triangular face.
+bool readOFF( const std::string &filename, Mesh &mesh, std::string &errmsg);
+
+// Read a triangle mesh in binary PLY format, of either byte order, from its
+// "vertex" element (properties x, y and z) and its "face" element (a list
+// vertex_indices or vertex_index, or three scalar index properties); other
+// elements and properties are skipped. When the positions are stored as
+// native floats x, y, z and nothing else, and likewise the faces as three
+// native ints, the arrays are mapped into the mesh without copying. Any other
+// layout is converted in parallel with a fixed stride, so apart from three
+// scalar indices the face element must hold only triangles.
+//
+// Returns false and a message of the form "file: reason" or, for the header,
+// "file:line: reason" in errmsg when the file cannot be read, is malformed, is
+// ASCII PLY, or contains a face that is not a triangle.
+bool readPLY( const std::string &filename, Mesh &mesh, std::string &errmsg);
+
+// Binary mesh cache.
+//
+// A cache file starts with a fixed header and a table of sections, each
+// holding one array of the mesh in native byte order, aligned to 64 bytes:
+// packed float positions, int triangle indices and, when present, float face
+// normals and the MeshTopology tables. Unknown sections are skipped, so newer
+// writers can add arrays without breaking older readers; incompatible changes
+// bump the version.
+//
+// The header also records the size and modification time of the file the
+// mesh was read from, so that a stale cache can be detected.
+
+const unsigned MESH_CACHE_VERSION = 1;
+
+// Arrays of doubles that other file formats store in a cache file after the
+// mesh, under section tags of FIRST_EXTRA_SECTION and up: a CacheExtra is
+// written and a CacheExtraMap is filled in on reading.
+const uint32_t FIRST_EXTRA_SECTION = 256;
+
+struct CacheExtra
+{
+    uint32_t                  tag;
+    const MeshBuffer<double> *data;
+};
+
+struct CacheExtraMap
+{
+    uint32_t            tag;
+    MeshBuffer<double> *data;
+};
+
+// Write mesh to filename. If source is given, its size and time stamp are
+// recorded. The file is written under a temporary name and then renamed.
+bool writeMeshCache( const std::string &filename, const Mesh &mesh, std::string &errmsg,
+                     const std::string &source = "", const std::vector<CacheExtra> &extra = {});
+
+// Map a cache file straight into the mesh arrays without copying them. The
+// triangles and the topology tables are checked in parallel, and the cache
+// is rejected if any index or offset in them is out of range; the positions
+// are not read. If source is given, the cache is also rejected unless it was
+// written for the current version of source. The extra arrays asked for are
+// mapped as well, and left empty if missing.
+bool readMeshCache( const std::string &filename, Mesh &mesh, std::string &errmsg,
+                    const std::string &source = "", const std::vector<CacheExtraMap> &extra = {});
+
+// Name of the cache file kept next to a mesh file.
+std::string getMeshCacheName( const std::string &filename);
+
+// Load an OFF file through its cache: map the cache if it is up to date,
+// otherwise parse the OFF, compute face normals and write a fresh cache next
+// to it. A cache that cannot be written is not an error. With withTopology
+// the MeshTopology tables are built as well if the cache lacks them, and the
+// cache is rewritten to hold them. A ".ply" file, in any case, is read with
+// readPLY() instead and not cached, as it is mapped already.
+bool loadMesh( const std::string &filename, Mesh &mesh, std::string &errmsg, bool useCache = 1,
+               bool withTopology = 0);
@@ -0,0 +1,226 @@
+#include "MeshTopology.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+using namespace std;
+
+namespace {
+
+// Turn per-item counts into CSR offsets; returns the total.
+size_t prefixSum( const atomic<int> *count, size_t n, MeshBuffer<int> &offsets)
+{
+    offsets.resize(n+1);
+    size_t sum = 0;
+    for( size_t i = 0; i < n; i++) {
+        offsets[i] = sum;
+        sum += count[i].load(memory_order_relaxed);
+    }
+    offsets[n] = sum;
+    return sum;
+}
+
+// Sort every CSR list so that the fill order of the threads does not matter.
+void sortLists( const MeshBuffer<int> &offsets, MeshBuffer<int> &list, size_t n)
+{
+    ThreadPool::instance().parallelFor( n, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++)
+            sort( list.data() + offsets[i], list.data() + offsets[i+1]);
+    });
+}
+
+// Every entry of list is in [0, n).
+bool isInRange( const MeshBuffer<int> &list, size_t n)
+{
+    atomic<bool> ok(1);
+    ThreadPool::instance().parallelFor( list.size(), VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++)
+            if( list[i] < 0 || (size_t)list[i] >= n) {
+                ok = 0;
+                return;
+            }
+    });
+    return ok;
+}
+
+// CSR offsets that start at 0, never decrease and end at the list size.
+bool isOffsets( const MeshBuffer<int> &offsets, size_t listSize)
+{
+    if( offsets.empty() || offsets[0] != 0 || (size_t)offsets[offsets.size()-1] != listSize) return 0;
+
+    atomic<bool> ok(1);
+    ThreadPool::instance().parallelFor( offsets.size() - 1, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++)
+            if( offsets[i] > offsets[i+1]) {
+                ok = 0;
+                return;
+            }
+    });
+    return ok;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MeshTopology::clear()
+{
+    edgeNodes.clear();
+    edgeFaceOffsets.clear();
+    edgeFaces.clear();
+    faceEdges.clear();
+    nodeFaceOffsets.clear();
+    nodeFaces.clear();
+    nodeEdgeOffsets.clear();
+    nodeEdges.clear();
+    boundaryEdges.clear();
+    nonManifoldEdges.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MeshTopology::build( const int *tri, size_t numFaces, size_t numNodes)
+{
+    PROFILE_SCOPE("MeshTopology::build");
+
+    clear();
+
+    ThreadPool &pool = ThreadPool::instance();
+    size_t numHalf = 3*numFaces;
+
+    // Bucket the half edges by their smaller vertex. Each entry packs the
+    // larger vertex in the high word and the half edge 3*face+corner in the
+    // low word, so sorting a bucket groups the copies of an edge together.
+    auto count  = make_unique<atomic<int>[]>(numNodes);
+    pool.parallelFor( numFaces, FACE_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t f = begin; f < end; f++)
+            for( int k = 0; k < 3; k++)
+                count[ min(tri[3*f+k], tri[3*f+(k+1)%3]) ]++;
+    });
+
+    MeshBuffer<int> halfOffsets;
+    prefixSum(count.get(), numNodes, halfOffsets);
+
+    for( size_t v = 0; v < numNodes; v++) count[v] = halfOffsets[v];
+
+    vector<uint64_t> half(numHalf);
+    pool.parallelFor( numFaces, FACE_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t f = begin; f < end; f++) {
+            for( int k = 0; k < 3; k++) {
+                int a = tri[3*f+k];
+                int b = tri[3*f+(k+1)%3];
+                int pos = count[ min(a,b) ]++;
+                half[pos] = (uint64_t(max(a,b)) << 32) | (3*f+k);
+            }
+        }
+    });
+
+    // Sort each bucket and count the distinct edges in it.
+    pool.parallelFor( numNodes, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t v = begin; v < end; v++) {
+            uint64_t *first = half.data() + halfOffsets[v];
+            uint64_t *last  = half.data() + halfOffsets[v+1];
+            sort(first, last);
+            int nedges = 0;
+            for( uint64_t *p = first; p < last; p++)
+                if( p == first || (*p >> 32) != (*(p-1) >> 32)) nedges++;
+            count[v] = nedges;
+        }
+    });
+
+    MeshBuffer<int> edgeStart;
+    size_t numEdges = prefixSum(count.get(), numNodes, edgeStart);
+
+    edgeNodes.resize(2*numEdges);
+    edgeFaceOffsets.resize(numEdges+1);
+    edgeFaces.resize(numHalf);
+    faceEdges.resize(numHalf);
+
+    pool.parallelFor( numNodes, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t v = begin; v < end; v++) {
+            int e = edgeStart[v] - 1;
+            for( int i = halfOffsets[v]; i < halfOffsets[v+1]; i++) {
+                int other = half[i] >> 32;
+                int he    = half[i] & 0xffffffff;
+                if( i == halfOffsets[v] || other != int(half[i-1] >> 32)) {
+                    e++;
+                    edgeNodes[2*e+0]   = v;
+                    edgeNodes[2*e+1]   = other;
+                    edgeFaceOffsets[e] = i;
+                }
+                edgeFaces[i]  = he/3;
+                faceEdges[he] = e;
+            }
+        }
+    });
+    edgeFaceOffsets[numEdges] = numHalf;
+
+    vector<int> boundary, nonmanifold;
+    for( size_t e = 0; e < numEdges; e++) {
+        if( isBoundary(e))    boundary.push_back(e);
+        if( isNonManifold(e)) nonmanifold.push_back(e);
+    }
+    boundaryEdges    = boundary;
+    nonManifoldEdges = nonmanifold;
+
+    // Vertex to face table.
+    for( size_t v = 0; v < numNodes; v++) count[v] = 0;
+    pool.parallelFor( numHalf, 3*FACE_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++) count[tri[i]]++;
+    });
+    prefixSum(count.get(), numNodes, nodeFaceOffsets);
+    for( size_t v = 0; v < numNodes; v++) count[v] = nodeFaceOffsets[v];
+
+    nodeFaces.resize(numHalf);
+    pool.parallelFor( numHalf, 3*FACE_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++) nodeFaces[ count[tri[i]]++ ] = i/3;
+    });
+    sortLists(nodeFaceOffsets, nodeFaces, numNodes);
+
+    // Vertex to edge table.
+    for( size_t v = 0; v < numNodes; v++) count[v] = 0;
+    pool.parallelFor( 2*numEdges, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++) count[edgeNodes[i]]++;
+    });
+    prefixSum(count.get(), numNodes, nodeEdgeOffsets);
+    for( size_t v = 0; v < numNodes; v++) count[v] = nodeEdgeOffsets[v];
+
+    nodeEdges.resize(2*numEdges);
+    pool.parallelFor( 2*numEdges, VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        for( size_t i = begin; i < end; i++) nodeEdges[ count[edgeNodes[i]]++ ] = i/2;
+    });
+    sortLists(nodeEdgeOffsets, nodeEdges, numNodes);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool MeshTopology::isConsistent( size_t numFaces, size_t numNodes) const
+{
+    size_t numEdges = getNumEdges();
+    return edgeNodes.size()       == 2*numEdges  &&
+           edgeFaceOffsets.size() == numEdges+1  &&
+           edgeFaces.size()       == 3*numFaces  &&
+           faceEdges.size()       == 3*numFaces  &&
+           nodeFaceOffsets.size() == numNodes+1  &&
+           nodeFaces.size()       == 3*numFaces  &&
+           nodeEdgeOffsets.size() == numNodes+1  &&
+           nodeEdges.size()       == 2*numEdges  &&
+           boundaryEdges.size()   <= numEdges    &&
+           nonManifoldEdges.size() <= numEdges   &&
+           isOffsets(edgeFaceOffsets, edgeFaces.size()) &&
+           isOffsets(nodeFaceOffsets, nodeFaces.size()) &&
+           isOffsets(nodeEdgeOffsets, nodeEdges.size()) &&
+           isInRange(edgeNodes, numNodes)        &&
+           isInRange(edgeFaces, numFaces)        &&
+           isInRange(faceEdges, numEdges)        &&
+           isInRange(nodeFaces, numFaces)        &&
+           isInRange(nodeEdges, numEdges)        &&
+           isInRange(boundaryEdges, numEdges)    &&
+           isInRange(nonManifoldEdges, numEdges);
+}
+
+////////////////////////////////////////////////////////////////////////////////
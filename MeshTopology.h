@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "MeshBuffer.h"
+
+// Compact adjacency of a triangle mesh, built in bulk from the triangle index
+// array. All tables are in compressed sparse row form: the entries belonging
+// to item i are list[offsets[i]] ... list[offsets[i+1]-1].
+//
+// Edges are numbered in increasing order of (smaller id, larger id), and all
+// per-vertex and per-edge lists are sorted, so the result does not depend on
+// the number of threads used to build it.
+
+struct MeshTopology
+{
+    // Build from numFaces triangles (three indices each) over numNodes vertices.
+    // The work is split over ThreadPool::instance().
+    void build( const int *triangles, size_t numFaces, size_t numNodes);
+    void clear();
+
+    bool   empty() const { return edgeFaceOffsets.empty(); }
+    size_t getNumEdges() const { return edgeNodes.size()/2; }
+
+    int getNumFaces( size_t e) const { return edgeFaceOffsets[e+1] - edgeFaceOffsets[e]; }
+
+    // Edges with exactly one incident face.
+    bool isBoundary( size_t e) const { return getNumFaces(e) == 1; }
+
+    // Edges shared by more than two faces.
+    bool isNonManifold( size_t e) const { return getNumFaces(e) > 2; }
+
+    // Two vertex ids per edge, smaller id first.
+    MeshBuffer<int> edgeNodes;
+
+    // Faces incident to each edge.
+    MeshBuffer<int> edgeFaceOffsets, edgeFaces;
+
+    // Three edges per face; edge k joins corners k and k+1.
+    MeshBuffer<int> faceEdges;
+
+    // Faces and edges incident to each vertex.
+    MeshBuffer<int> nodeFaceOffsets, nodeFaces;
+    MeshBuffer<int> nodeEdgeOffsets, nodeEdges;
+
+    // Ids of boundary and non-manifold edges, in increasing order.
+    MeshBuffer<int> boundaryEdges;
+    MeshBuffer<int> nonManifoldEdges;
+
+    // Check that the table sizes agree with each other and with the mesh, and
+    // that every offset and index is in range, so that tables read from a
+    // file can be used safely. The work is split over ThreadPool::instance().
+    bool isConsistent( size_t numFaces, size_t numNodes) const;
+};
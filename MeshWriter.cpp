@@ -0,0 +1,242 @@
+#include "MeshWriter.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+namespace {
+
+// Records formatted by one task.
+const size_t WRITE_CHUNK = 4096;
+
+// Longest text of a float with the fewest digits that round trip, such as
+// "-1.17549435e-38", and of an int.
+const size_t FLOAT_CHARS = 16;
+const size_t INT_CHARS   = 12;
+
+const size_t PLY_ALIGNMENT = 64;
+
+// Output numbering of the vertices used by some triangle. Both tables stay
+// empty when every vertex is used.
+struct Compaction
+{
+    size_t      numUsed = 0;
+    vector<int> used;     // source index of the k-th written vertex
+    vector<int> newid;    // output index of a used source vertex
+
+    int source( size_t k) const { return used.empty() ? (int)k : used[k]; }
+    int target( int i)    const { return newid.empty() ? i : newid[i]; }
+};
+
+void compact( const Mesh &mesh, Compaction &c)
+{
+    size_t numnodes = mesh.getNumNodes();
+    const MeshBuffer<int> &triangles = mesh.getTriangles();
+
+    vector<char> mark(numnodes, 0);
+    for( size_t i = 0; i < triangles.size(); i++)
+        mark[triangles[i]] = 1;
+
+    c.numUsed = count(mark.begin(), mark.end(), 1);
+    c.used.clear();
+    c.newid.clear();
+    if( c.numUsed == numnodes) return;
+
+    c.used.reserve(c.numUsed);
+    c.newid.assign(numnodes, -1);
+    for( size_t i = 0; i < numnodes; i++) {
+        if( !mark[i]) continue;
+        c.newid[i] = c.used.size();
+        c.used.push_back(i);
+    }
+}
+
+inline char *putFloat( char *p, float x)
+{
+    return to_chars(p, p + FLOAT_CHARS, x).ptr;
+}
+
+inline char *putInt( char *p, int x)
+{
+    return to_chars(p, p + INT_CHARS, x).ptr;
+}
+
+// Write n records, each produced by put(k, p) in at most maxSize bytes from p
+// and returning its end. Blocks of chunks are formatted in parallel, then each
+// chunk is written with one call, in order.
+template<class Put>
+void writeRecords( ofstream &out, size_t n, size_t maxSize, const Put &put)
+{
+    ThreadPool &pool = ThreadPool::instance();
+    size_t numChunks = 4*pool.getNumThreads();
+    size_t block     = numChunks*WRITE_CHUNK;
+
+    vector<char>   buffer( min(n, block)*maxSize);
+    vector<size_t> length( numChunks);
+
+    for( size_t first = 0; first < n && out; first += block) {
+        size_t count = min(block, n - first);
+        pool.parallelFor( count, WRITE_CHUNK, [&](size_t begin, size_t end) {
+            char *start = buffer.data() + begin*maxSize;
+            char *p = start;
+            for( size_t k = begin; k < end; k++)
+                p = put(first + k, p);
+            length[begin/WRITE_CHUNK] = p - start;
+        });
+
+        for( size_t c = 0; c*WRITE_CHUNK < count; c++)
+            out.write( buffer.data() + c*WRITE_CHUNK*maxSize, length[c]);
+    }
+}
+
+// Vertex and face lines of the text formats, with the given prefixes and
+// index base.
+bool writeText( const string &filename, const Mesh &mesh, string &errmsg, const string &header,
+                const char *vertexTag, const char *faceTag, int base, const Compaction &c)
+{
+    ofstream ofile(filename.c_str(), ios::out | ios::binary);
+    if( ofile.fail() ) {
+        errmsg = filename + ": cannot create file";
+        return 0;
+    }
+    ofile.write( header.data(), header.size());
+
+    size_t vlen = strlen(vertexTag), flen = strlen(faceTag);
+
+    writeRecords( ofile, c.numUsed, vlen + 3*FLOAT_CHARS + 3, [&](size_t k, char *p) {
+        const float *xyz = mesh.getXYZ( c.source(k) );
+        memcpy(p, vertexTag, vlen);
+        p += vlen;
+        p = putFloat(p, xyz[0]);
+        *p++ = ' ';
+        p = putFloat(p, xyz[1]);
+        *p++ = ' ';
+        p = putFloat(p, xyz[2]);
+        *p++ = '\n';
+        return p;
+    });
+
+    const int *tri = mesh.getTriangles().data();
+    writeRecords( ofile, mesh.getNumFaces(), flen + 3*INT_CHARS + 3, [&](size_t k, char *p) {
+        memcpy(p, faceTag, flen);
+        p += flen;
+        p = putInt(p, c.target(tri[3*k+0]) + base);
+        *p++ = ' ';
+        p = putInt(p, c.target(tri[3*k+1]) + base);
+        *p++ = ' ';
+        p = putInt(p, c.target(tri[3*k+2]) + base);
+        *p++ = '\n';
+        return p;
+    });
+
+    ofile.close();
+    if( ofile.fail() ) {
+        errmsg = filename + ": cannot write file";
+        return 0;
+    }
+    return 1;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool writeOFF( const string &filename, const Mesh &mesh, string &errmsg)
+{
+    PROFILE_SCOPE("writeOFF");
+
+    Compaction c;
+    compact(mesh, c);
+
+    string header = "OFF\n" + to_string(c.numUsed) + " " + to_string(mesh.getNumFaces()) + " 0\n";
+    return writeText( filename, mesh, errmsg, header, "", "3 ", 0, c);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool writeOBJ( const string &filename, const Mesh &mesh, string &errmsg)
+{
+    PROFILE_SCOPE("writeOBJ");
+
+    Compaction c;
+    compact(mesh, c);
+
+    return writeText( filename, mesh, errmsg, "", "v ", "f ", 1, c);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool writePLY( const string &filename, const Mesh &mesh, string &errmsg)
+{
+    PROFILE_SCOPE("writePLY");
+
+    Compaction c;
+    compact(mesh, c);
+    size_t numfaces = mesh.getNumFaces();
+
+    const uint16_t probe = 1;
+    bool little = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+
+    string header = string("ply\nformat ") + (little ? "binary_little_endian" : "binary_big_endian") + " 1.0\n";
+    header += "element vertex " + to_string(c.numUsed) + "\n";
+    header += "property float x\nproperty float y\nproperty float z\n";
+    header += "element face " + to_string(numfaces) + "\n";
+    header += "property list uchar int vertex_indices\n";
+
+    const string comment = "comment", end = "end_header\n";
+    size_t length = header.size() + comment.size() + 1 + end.size();
+    size_t pad    = (PLY_ALIGNMENT - length % PLY_ALIGNMENT) % PLY_ALIGNMENT;
+    header += comment + string(pad, ' ') + "\n" + end;
+
+    ofstream ofile(filename.c_str(), ios::out | ios::binary);
+    if( ofile.fail() ) {
+        errmsg = filename + ": cannot create file";
+        return 0;
+    }
+    ofile.write( header.data(), header.size());
+
+    // Without unused vertices the positions go out as they are.
+    if( c.used.empty() ) {
+        ofile.write( reinterpret_cast<const char*>(mesh.coords.data()), mesh.coords.size()*sizeof(float));
+    } else {
+        writeRecords( ofile, c.numUsed, 3*sizeof(float), [&](size_t k, char *p) {
+            memcpy(p, mesh.getXYZ( c.used[k] ), 3*sizeof(float));
+            return p + 3*sizeof(float);
+        });
+    }
+
+    const int *tri = mesh.getTriangles().data();
+    writeRecords( ofile, numfaces, 1 + 3*sizeof(int), [&](size_t k, char *p) {
+        int v[3] = { c.target(tri[3*k+0]), c.target(tri[3*k+1]), c.target(tri[3*k+2]) };
+        *p = 3;
+        memcpy(p + 1, v, sizeof(v));
+        return p + 1 + sizeof(v);
+    });
+
+    ofile.close();
+    if( ofile.fail() ) {
+        errmsg = filename + ": cannot write file";
+        return 0;
+    }
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool saveMesh( const string &filename, const Mesh &mesh, string &errmsg)
+{
+    size_t dot = filename.rfind('.');
+    string ext = dot == string::npos ? "" : filename.substr(dot);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    if( ext == ".off") return writeOFF(filename, mesh, errmsg);
+    if( ext == ".ply") return writePLY(filename, mesh, errmsg);
+    return writeOBJ(filename, mesh, errmsg);
+}
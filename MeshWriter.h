@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "Mesh.h"
+
+// Mesh exporters. Only the vertices used by some triangle are written, in
+// index order, and the triangles are renumbered to match, so the output only
+// depends on the mesh. Text formats print every coordinate with the fewest
+// digits that read back as the same float. The lines are formatted in
+// parallel on ThreadPool::instance() into large buffers that are written with
+// one call each.
+//
+// All return false and a message of the form "file: reason" in errmsg when
+// the file cannot be written.
+
+bool writeOFF( const std::string &filename, const Mesh &mesh, std::string &errmsg);
+bool writeOBJ( const std::string &filename, const Mesh &mesh, std::string &errmsg);
+
+// Binary PLY in the byte order of the machine: float x, y, z per vertex and a
+// uchar count with three int indices per face. The header is padded with a
+// comment so that the vertex data starts at a multiple of 64 bytes.
+bool writePLY( const std::string &filename, const Mesh &mesh, std::string &errmsg);
+
+// Choose the writer from the extension of filename: ".off", ".ply", or else
+// OBJ.
+bool saveMesh( const std::string &filename, const Mesh &mesh, std::string &errmsg);
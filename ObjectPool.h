@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+
+#include "Profile.h"
+
+// Arena for objects of one type. Objects are constructed in large contiguous
+// blocks and are never freed one by one; clear() destroys all of them at once
+// and releases the blocks. Pointers stay valid until then, also when the pool
+// itself is moved.
+
+template<class T>
+class ObjectPool
+{
+public:
+    ObjectPool() {}
+    ~ObjectPool() { clear(); }
+
+    ObjectPool( const ObjectPool &) = delete;
+    ObjectPool &operator=( const ObjectPool &) = delete;
+
+    ObjectPool( ObjectPool &&p) noexcept { *this = std::move(p); }
+    ObjectPool &operator=( ObjectPool &&p) noexcept {
+        if( this == &p) return *this;
+        clear();
+        blocks   = std::move(p.blocks);
+        capacity = std::move(p.capacity);
+        used     = p.used;
+        total    = p.total;
+        p.used   = 0;
+        p.total  = 0;
+        return *this;
+    }
+
+    // Make room for n more objects in a single block.
+    void reserve( size_t n) {
+        size_t room = blocks.empty() ? 0 : capacity.back() - used;
+        if( n > room) addBlock(n);
+    }
+
+    template<class... Args>
+    T *newObject( Args&&... args) {
+        if( blocks.empty() || used == capacity.back())
+            addBlock( std::max<size_t>(MIN_BLOCK, total));
+        T *p = reinterpret_cast<T*>(blocks.back().get()) + used;
+        new (p) T( std::forward<Args>(args)...);
+        used++;
+        total++;
+        return p;
+    }
+
+    size_t size() const { return total; }
+
+    void clear() {
+        if( !std::is_trivially_destructible<T>::value) {
+            for( size_t b = 0; b < blocks.size(); b++) {
+                size_t n = (b + 1 == blocks.size()) ? used : capacity[b];
+                T *p = reinterpret_cast<T*>(blocks[b].get());
+                for( size_t i = 0; i < n; i++) p[i].~T();
+            }
+        }
+        blocks.clear();
+        capacity.clear();
+        used  = 0;
+        total = 0;
+    }
+
+private:
+    static const size_t MIN_BLOCK = 1024;
+
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+    void addBlock( size_t n) {
+        // Objects left unused at the end of the current block stay unused.
+        if( !blocks.empty() ) capacity.back() = used;
+        PROFILE_COUNT("pool blocks allocated", 1);
+        blocks.emplace_back( new Storage[n] );
+        capacity.push_back(n);
+        used = 0;
+    }
+
+    std::vector<std::unique_ptr<Storage[]>> blocks;
+    std::vector<size_t> capacity;
+    size_t used  = 0;
+    size_t total = 0;
+};
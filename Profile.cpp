@@ -0,0 +1,224 @@
+#include "Profile.h"
+
+#ifdef SAM_PROFILE
+
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+namespace Profile {
+
+namespace {
+
+struct Phase
+{
+    long   calls = 0;
+    double total = 0.0, max = 0.0;   // seconds
+    double frame = 0.0;              // seconds in the current frame
+};
+
+struct Counter
+{
+    long total = 0;
+    long frame = 0;                  // in the current frame
+};
+
+struct Event
+{
+    const char *name;
+    int    tid;
+    double start, duration;          // microseconds since startup
+};
+
+struct CounterSample
+{
+    double time;
+    string name;
+    long   value;
+};
+
+// Events beyond this many are counted in the summary but left out of the
+// trace, so that a long run cannot exhaust memory.
+const size_t MAX_EVENTS = 1 << 22;
+
+struct Registry
+{
+    Registry() : startTime(Clock::now()), frameStart(startTime) {
+        atexit( []() { dump(); });
+    }
+
+    mutex lock;
+    Clock::time_point startTime, frameStart;
+
+    map<string,Phase>   phases;
+    map<string,Counter> counters;
+    vector<Event>         events;
+    vector<CounterSample> samples;
+    size_t dropped = 0;
+
+    long   frames = 0;
+    double frameTotal = 0.0, frameMax = 0.0;
+
+    map<thread::id,int> threads;
+
+    double micros( Clock::time_point t) const {
+        return chrono::duration<double,micro>(t - startTime).count();
+    }
+
+    int getThread() {
+        auto it = threads.find( this_thread::get_id() );
+        if( it != threads.end() ) return it->second;
+        int id = threads.size();
+        threads[this_thread::get_id()] = id;
+        return id;
+    }
+};
+
+Registry &registry()
+{
+    static Registry *r = new Registry;   // outlives the atexit handler
+    return *r;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void addPhase( const char *name, Clock::time_point start, Clock::time_point end)
+{
+    Registry &r = registry();
+    double sec = chrono::duration<double>(end - start).count();
+
+    lock_guard<mutex> guard(r.lock);
+    Phase &p = r.phases[name];
+    p.calls++;
+    p.total += sec;
+    p.frame += sec;
+    p.max    = std::max(p.max, sec);
+
+    if( r.events.size() < MAX_EVENTS)
+        r.events.push_back( {name, r.getThread(), r.micros(start), 1.0e6*sec} );
+    else
+        r.dropped++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void count( const char *name, long n)
+{
+    Registry &r = registry();
+
+    lock_guard<mutex> guard(r.lock);
+    Counter &c = r.counters[name];
+    c.total += n;
+    c.frame += n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void endFrame()
+{
+    Registry &r = registry();
+    Clock::time_point now = Clock::now();
+
+    lock_guard<mutex> guard(r.lock);
+    double sec = chrono::duration<double>(now - r.frameStart).count();
+    r.frameStart = now;
+    r.frames++;
+    r.frameTotal += sec;
+    r.frameMax    = max(r.frameMax, sec);
+
+    static const bool verbose = getenv("SAM_PROFILE_FRAMES") != nullptr;
+    if( verbose) {
+        fprintf(stderr, "frame %ld: %.3f ms", r.frames, 1.0e3*sec);
+        for( auto &p : r.phases)
+            if( p.second.frame > 0.0) fprintf(stderr, ", %s %.3f ms", p.first.c_str(), 1.0e3*p.second.frame);
+        for( auto &c : r.counters)
+            if( c.second.frame) fprintf(stderr, ", %s %ld", c.first.c_str(), c.second.frame);
+        fprintf(stderr, "\n");
+    }
+
+    double t = r.micros(now);
+    for( auto &p : r.phases) p.second.frame = 0.0;
+    for( auto &c : r.counters) {
+        if( r.samples.size() < MAX_EVENTS)
+            r.samples.push_back( {t, c.first, c.second.frame} );
+        c.second.frame = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void writeTrace( const Registry &r, const string &filename)
+{
+    ofstream ofile( filename.c_str(), ios::out);
+    if( ofile.fail() ) {
+        fprintf(stderr, "Warning: cannot write trace %s\n", filename.c_str());
+        return;
+    }
+
+    char line[512];
+    ofile << "{\"traceEvents\": [\n";
+    bool first = 1;
+    for( const Event &e : r.events) {
+        snprintf(line, sizeof(line), "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                 first ? "" : ",\n", e.name, e.tid, e.start, e.duration);
+        ofile << line;
+        first = 0;
+    }
+    for( const CounterSample &s : r.samples) {
+        snprintf(line, sizeof(line), "%s{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"per frame\": %ld}}",
+                 first ? "" : ",\n", s.name.c_str(), s.time, s.value);
+        ofile << line;
+        first = 0;
+    }
+    ofile << "\n]}\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void dump()
+{
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+
+    long frames = max(r.frames, 1L);
+
+    fprintf(stderr, "\n%-28s %10s %12s %12s %12s %12s\n",
+            "phase", "calls", "total ms", "mean us", "max us", "ms/frame");
+    for( auto &p : r.phases) {
+        const Phase &ph = p.second;
+        fprintf(stderr, "%-28s %10ld %12.3f %12.3f %12.3f %12.3f\n", p.first.c_str(), ph.calls,
+                1.0e3*ph.total, 1.0e6*ph.total/ph.calls, 1.0e6*ph.max, 1.0e3*ph.total/frames);
+    }
+
+    if( !r.counters.empty() ) {
+        fprintf(stderr, "\n%-28s %16s %16s\n", "counter", "total", "per frame");
+        for( auto &c : r.counters)
+            fprintf(stderr, "%-28s %16ld %16.1f\n", c.first.c_str(), c.second.total, (double)c.second.total/frames);
+    }
+
+    if( r.frames) {
+        fprintf(stderr, "\nframes %ld, mean %.3f ms, max %.3f ms\n",
+                r.frames, 1.0e3*r.frameTotal/r.frames, 1.0e3*r.frameMax);
+    }
+    if( r.dropped)
+        fprintf(stderr, "%zu events were left out of the trace\n", r.dropped);
+
+    const char *env = getenv("SAM_TRACE");
+    string filename = env ? env : "sam_trace.json";
+    writeTrace( r, filename);
+    fprintf(stderr, "trace written to %s\n", filename.c_str());
+}
+
+} // namespace Profile
+
+#endif
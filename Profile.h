@@ -0,0 +1,59 @@
+#pragma once
+
+// Instrumentation of the hot paths. It is compiled in only when SAM_PROFILE
+// is defined ("make PROFILE=1"); otherwise the macros below expand to nothing.
+//
+//     PROFILE_SCOPE("phase")   time the enclosing block as one call of phase
+//     PROFILE_COUNT("name", n) add n to a counter
+//     PROFILE_FRAME()          close the current frame
+//
+// At exit a summary of the phases, counters and frames is printed to stderr
+// and the timeline is written in Chrome trace format (chrome://tracing,
+// Perfetto) to the file named by SAM_TRACE, default "sam_trace.json". If
+// SAM_PROFILE_FRAMES is set, every frame is also summarised as it closes.
+
+#ifdef SAM_PROFILE
+
+#include <chrono>
+
+namespace Profile {
+
+typedef std::chrono::steady_clock Clock;
+
+void addPhase( const char *name, Clock::time_point start, Clock::time_point end);
+void count( const char *name, long n);
+void endFrame();
+
+// Print the summary and write the trace; called automatically at exit.
+void dump();
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer( const char *n) : name(n), start(Clock::now()) {}
+    ~ScopedTimer() { addPhase( name, start, Clock::now()); }
+
+    ScopedTimer( const ScopedTimer &) = delete;
+    ScopedTimer &operator=( const ScopedTimer &) = delete;
+
+private:
+    const char        *name;
+    Clock::time_point  start;
+};
+
+} // namespace Profile
+
+#define PROFILE_CONCAT2(a,b) a##b
+#define PROFILE_CONCAT(a,b)  PROFILE_CONCAT2(a,b)
+
+#define PROFILE_SCOPE(name)    Profile::ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(name)
+#define PROFILE_COUNT(name, n) Profile::count( name, n)
+#define PROFILE_FRAME()        Profile::endFrame()
+
+#else
+
+#define PROFILE_SCOPE(name)    ((void)0)
+#define PROFILE_COUNT(name, n) ((void)0)
+#define PROFILE_FRAME()        ((void)0)
+
+#endif
@@ -0,0 +1,106 @@
+#include "ScrewMotion.h"
+#include "Profile.h"
+
+#include <cmath>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ScrewMotion::setLog( const Eigen::Matrix4d &mat)
+{
+    logA  = mat;
+    logA2 = logA*logA;
+
+    Eigen::Matrix3d W = logA.block(0,0,3,3);
+    v << logA(3,0), logA(3,1), logA(3,2);
+
+    // Same threshold as AffineLib::expSE at t = 1.
+    double norm2 = W(0,1)*W(0,1) + W(0,2)*W(0,2) + W(1,2)*W(1,2);
+    rotating = norm2 >= EPSILON;
+
+    if( !rotating) {
+        theta = 0.0;
+        pitch = 0.0;
+        axis.setZero();
+        K.setZero();
+        K2.setZero();
+        p.setZero();
+        q.setZero();
+        return;
+    }
+
+    // With the unit skew matrix K = W/theta and s = sin(t theta), c = cos(t theta):
+    //   R(t) = I + s K + (1-c) K^2
+    //   l(t) = t v + (1-c) K^T v/theta + (t theta - s) K^2 v/theta
+    theta = sqrt(norm2);
+    K     = W/theta;
+    K2    = K*K;
+    p     = K.transpose()*v/theta;
+    q     = K2*v/theta;
+
+    axis << -K(1,2), K(0,2), -K(0,1);
+    pitch = v.dot(axis)/theta;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ScrewMotion::set( double t, double s, double c, Eigen::Matrix4d &A) const
+{
+    Eigen::Matrix3d R = Eigen::Matrix3d::Identity() + s*K + (1.0-c)*K2;
+    Eigen::Vector3d l = t*v + (1.0-c)*p + (t*theta - s)*q;
+    A = AffineLib::pad(R, l);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix4d ScrewMotion::evaluate( double t) const
+{
+    PROFILE_COUNT("poses evaluated", 1);
+
+    if( !rotating)
+        return Eigen::Matrix4d::Identity() + t*logA + (0.5*t*t)*logA2;
+
+    Eigen::Matrix4d A;
+    set( t, sin(t*theta), cos(t*theta), A);
+    return A;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ScrewMotion::evaluate( const double *t, size_t n, Eigen::Matrix4d *A) const
+{
+    PROFILE_SCOPE("ScrewMotion::evaluate");
+    PROFILE_COUNT("poses evaluated", n);
+
+    if( !rotating) {
+        for( size_t i = 0; i < n; i++)
+            A[i] = Eigen::Matrix4d::Identity() + t[i]*logA + (0.5*t[i]*t[i])*logA2;
+        return;
+    }
+
+    // Take the sines and cosines in a separate pass so that the compiler can
+    // use its vector math routines for them.
+    const size_t BLOCK = 256;
+    double s[BLOCK], c[BLOCK];
+
+    for( size_t i0 = 0; i0 < n; i0 += BLOCK) {
+        size_t m = min(BLOCK, n - i0);
+        for( size_t i = 0; i < m; i++) {
+            s[i] = sin(t[i0+i]*theta);
+            c[i] = cos(t[i0+i]*theta);
+        }
+        for( size_t i = 0; i < m; i++)
+            set( t[i0+i], s[i], c[i], A[i0+i]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ScrewMotion::evaluate( const vector<double> &t, vector<Eigen::Matrix4d> &A) const
+{
+    A.resize( t.size() );
+    evaluate( t.data(), t.size(), A.data() );
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Dense>
+#include "affinelib.h"
+
+// Closed form of t -> expSE(t*logA) for a fixed screw logA. The axis, angle
+// and pitch are factored once in setLog(), after which a pose costs one sin,
+// one cos and a few scalar products. Matrices follow the AffineLib convention
+// of acting on row vectors.
+
+class ScrewMotion
+{
+public:
+    ScrewMotion() { setLog( Eigen::Matrix4d::Zero() ); }
+    explicit ScrewMotion( const Eigen::Matrix4d &logA) { setLog(logA); }
+
+    // logA must be the log of a rigid motion, e.g. from AffineLib::logSEc.
+    void setLog( const Eigen::Matrix4d &logA);
+
+    const Eigen::Matrix4d &getLog() const { return logA; }
+
+    // Unit rotation axis (zero for a pure translation), rotation angle, and
+    // translation along the axis per radian of rotation.
+    const Eigen::Vector3d &getAxis()  const { return axis; }
+    double                 getAngle() const { return theta; }
+    double                 getPitch() const { return pitch; }
+
+    Eigen::Matrix4d evaluate( double t) const;
+
+    // A[i] = expSE(t[i]*logA) for n time samples.
+    void evaluate( const double *t, size_t n, Eigen::Matrix4d *A) const;
+    void evaluate( const std::vector<double> &t, std::vector<Eigen::Matrix4d> &A) const;
+
+private:
+    Eigen::Matrix4d logA, logA2;
+    Eigen::Matrix3d K, K2;        // unit skew matrix of the axis and its square
+    Eigen::Vector3d v, p, q;      // translation terms
+    Eigen::Vector3d axis;
+    double theta = 0.0, pitch = 0.0;
+    bool   rotating = 0;
+
+    void set( double t, double s, double c, Eigen::Matrix4d &A) const;
+};
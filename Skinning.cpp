@@ -0,0 +1,361 @@
+#include "Skinning.h"
+#include "BatchMath.h"
+#include "TransformKernel.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+void SkinWeights::resize( size_t n)
+{
+    for( int k = 0; k < MAX_INFLUENCES; k++) {
+        handle[k].resize(n, 0);
+        weight[k].resize(n, 0.0f);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void SkinWeights::set( size_t v, const int *handles, const float *weights, int n)
+{
+    vector<pair<float,int> > w;
+    for( int i = 0; i < n; i++)
+        if( weights[i] > 0.0f) w.push_back( make_pair(weights[i], handles[i]) );
+
+    int m = min( (int)w.size(), MAX_INFLUENCES);
+    partial_sort( w.begin(), w.begin() + m, w.end(), greater<pair<float,int> >() );
+
+    float sum = 0.0f;
+    for( int k = 0; k < m; k++) sum += w[k].first;
+
+    for( int k = 0; k < MAX_INFLUENCES; k++) {
+        handle[k][v] = k < m ? w[k].second : 0;
+        weight[k][v] = k < m ? w[k].first/sum : 0.0f;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int SkinWeights::getMaxHandle() const
+{
+    int maxHandle = -1;
+    for( int k = 0; k < MAX_INFLUENCES; k++)
+        for( size_t v = 0; v < size(); v++)
+            if( weight[k][v] > 0.0f) maxHandle = max(maxHandle, handle[k][v]);
+    return maxHandle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool readSkinWeights( const string &filename, size_t numVertices, SkinWeights &weights, string &errmsg)
+{
+    ifstream ifile( filename.c_str(), ios::in);
+    if( ifile.fail() ) {
+        errmsg = filename + ": cannot open file";
+        return 0;
+    }
+
+    weights.resize(numVertices);
+
+    string line;
+    vector<int>   h;
+    vector<float> w;
+    for( size_t v = 0; v < numVertices; v++) {
+        if( !getline(ifile, line) ) {
+            errmsg = filename + ": expected a line for each of the " + to_string(numVertices) + " vertices";
+            return 0;
+        }
+
+        h.clear();
+        w.clear();
+        istringstream ss(line);
+        int   hi;
+        float wi;
+        while( ss >> hi >> wi) {
+            if( hi < 0) {
+                errmsg = filename + ": negative handle on line " + to_string(v+1);
+                return 0;
+            }
+            h.push_back(hi);
+            w.push_back(wi);
+        }
+        if( !ss.eof() ) {
+            errmsg = filename + ": expected handle weight pairs on line " + to_string(v+1);
+            return 0;
+        }
+
+        weights.set( v, h.data(), w.data(), h.size() );
+    }
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Skinning::setHandles( const vector<SteadyMotion> &motions)
+{
+    numHandles = motions.size();
+    maxShear   = 0.0;
+    for( int j = 0; j < 12; j++) logs[j].resize(numHandles);
+
+    for( int i = 0; i < numHandles; i++) {
+        const SteadyMotion &m = motions[i];
+        const Eigen::Matrix3d &U  = m.getShearBasis();
+        const Eigen::Vector3d &mu = m.getShearLog();
+        Eigen::Matrix3d logS = Eigen::Matrix3d::Zero();
+        if( !m.isRigid() ) {
+            logS     = U*mu.asDiagonal()*U.transpose();
+            maxShear = max(maxShear, mu.cwiseAbs().maxCoeff() );
+        }
+        const Eigen::Matrix4d &logB = m.getScrew().getLog();
+
+        double entries[12] = { logS(0,0), logS(1,1), logS(2,2), logS(0,1), logS(0,2), logS(1,2),
+                               logB(0,1), logB(0,2), logB(1,2), logB(3,0), logB(3,1), logB(3,2) };
+        for( int j = 0; j < 12; j++) logs[j][i] = entries[j];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Skinning::setWeights( const SkinWeights &w)
+{
+    weights   = w;
+    maxHandle = weights.getMaxHandle();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix4d Skinning::getMatrix( size_t v, double t) const
+{
+    Eigen::Matrix3d X = Eigen::Matrix3d::Zero();
+    Eigen::Matrix4d Y = Eigen::Matrix4d::Zero();
+    for( int k = 0; k < MAX_INFLUENCES; k++) {
+        double w = weights.weight[k][v];
+        if( w == 0.0) continue;
+
+        int h = weights.handle[k][v];
+        Eigen::Matrix3d logS;
+        logS << logs[0][h], logs[3][h], logs[4][h],
+                logs[3][h], logs[1][h], logs[5][h],
+                logs[4][h], logs[5][h], logs[2][h];
+        Eigen::Matrix3d W;
+        W <<          0.0,  logs[6][h], logs[7][h],
+              -logs[6][h],         0.0, logs[8][h],
+              -logs[7][h], -logs[8][h],        0.0;
+        Eigen::Vector3d l( logs[9][h], logs[10][h], logs[11][h] );
+
+        X += w*logS;
+        Y += w*AffineLib::pad(W, l, 0.0);
+    }
+
+    Eigen::Matrix3d S = AffineLib::expSym( Eigen::Matrix3d(t*X) );
+    return AffineLib::pad( S, Eigen::Vector3d::Zero() )*AffineLib::expSE( Eigen::Matrix4d(t*Y) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+using namespace BatchMath;
+
+// Everything the kernel reads and writes for one call of apply().
+struct SkinJob
+{
+    const float  *src;
+    float        *dst;
+    const int    *handle[MAX_INFLUENCES];
+    const float  *weight[MAX_INFLUENCES];
+    const double *logs[12];
+    double t;
+    double scale;        // 2^-squarings
+    int    squarings;
+};
+
+// Vertices are handled in strips of this many lanes, so that the squarings,
+// whose count is only known at run time, get a vectorized loop of their own.
+const size_t STRIP = 64;
+
+// Degree of the Taylor polynomial of exp on symmetric logs of spectral norm
+// at most SHEAR_NORM, where it is accurate to about 1e-11.
+const int    TAYLOR_DEGREE = 8;
+const double SHEAR_NORM    = 0.25;
+
+// C = A B for symmetric A and B that commute, stored as xx, yy, zz, xy, xz, yz.
+BATCH_INLINE void symProduct( const double *A, const double *B, double *C)
+{
+    C[0] = A[0]*B[0] + A[3]*B[3] + A[4]*B[4];
+    C[1] = A[3]*B[3] + A[1]*B[1] + A[5]*B[5];
+    C[2] = A[4]*B[4] + A[5]*B[5] + A[2]*B[2];
+    C[3] = A[0]*B[3] + A[3]*B[1] + A[4]*B[5];
+    C[4] = A[0]*B[4] + A[3]*B[5] + A[4]*B[2];
+    C[5] = A[3]*B[4] + A[1]*B[5] + A[5]*B[2];
+}
+
+// y = x W for the skew W with upper entries w01, w02, w12.
+BATCH_INLINE void skewProduct( const double *x, const double *w, double *y)
+{
+    y[0] = -x[1]*w[0] - x[2]*w[1];
+    y[1] =  x[0]*w[0] - x[2]*w[2];
+    y[2] =  x[0]*w[1] + x[1]*w[2];
+}
+
+// Without SHEAR every handle is rigid and S is the identity.
+template<bool SHEAR>
+BATCH_INLINE void skinKernel( const SkinJob &job, size_t begin, size_t end)
+{
+    // A local copy, which the stores cannot alias.
+    const SkinJob in = job;
+    const int first = SHEAR ? 0 : 6;
+
+    for( size_t s0 = begin; s0 < end; s0 += STRIP) {
+        size_t n = min(STRIP, end - s0);
+        double S[6][STRIP], B[6][STRIP];
+
+        // Blend the logs of the influences and take the Taylor polynomial of
+        // exp on the scaled symmetric part.
+#pragma GCC ivdep
+        for( size_t i = 0; i < n; i++) {
+            double x[12] = {};
+#pragma GCC unroll 4
+            for( int k = 0; k < MAX_INFLUENCES; k++) {
+                int    h = in.handle[k][s0+i];
+                double w = in.t*in.weight[k][s0+i];
+                for( int j = first; j < 12; j++) x[j] += w*in.logs[j][h];
+            }
+
+            if( SHEAR) {
+                double X[6], P[6], Q[6];
+                for( int j = 0; j < 6; j++) X[j] = in.scale*x[j];
+                for( int j = 0; j < 6; j++) P[j] = (j < 3 ? 1.0 : 0.0) + X[j]*(1.0/TAYLOR_DEGREE);
+#pragma GCC unroll 8
+                for( int k = TAYLOR_DEGREE - 1; k >= 1; k--) {
+                    symProduct(X, P, Q);
+                    for( int j = 0; j < 6; j++) P[j] = (j < 3 ? 1.0 : 0.0) + Q[j]*(1.0/k);
+                }
+                for( int j = 0; j < 6; j++) S[j][i] = P[j];
+            }
+            for( int j = 0; j < 6; j++) B[j][i] = x[6+j];
+        }
+
+        // Undo the scaling: exp(X) = exp(2^-s X)^(2^s).
+        for( int r = 0; SHEAR && r < in.squarings; r++) {
+#pragma GCC ivdep
+            for( size_t i = 0; i < n; i++) {
+                double P[6], Q[6];
+                for( int j = 0; j < 6; j++) P[j] = S[j][i];
+                symProduct(P, P, Q);
+                for( int j = 0; j < 6; j++) S[j][i] = Q[j];
+            }
+        }
+
+        // p' = (p S) R + l with R = I + a W + b W^2 and l = v + b vW + d vW^2.
+#pragma GCC ivdep
+        for( size_t i = 0; i < n; i++) {
+            const float *p = in.src + 3*(s0+i);
+            double q[3] = { p[0], p[1], p[2] };
+            if( SHEAR) {
+                double x = q[0], y = q[1], z = q[2];
+                q[0] = x*S[0][i] + y*S[3][i] + z*S[4][i];
+                q[1] = x*S[3][i] + y*S[1][i] + z*S[5][i];
+                q[2] = x*S[4][i] + y*S[5][i] + z*S[2][i];
+            }
+
+            double w[3] = { B[0][i], B[1][i], B[2][i] };
+            double v[3] = { B[3][i], B[4][i], B[5][i] };
+            double a, b, d;
+            expSECoefficients( w[0]*w[0] + w[1]*w[1] + w[2]*w[2], a, b, d);
+
+            double qW[3], qW2[3], vW[3], vW2[3];
+            skewProduct(q,  w, qW);
+            skewProduct(qW, w, qW2);
+            skewProduct(v,  w, vW);
+            skewProduct(vW, w, vW2);
+
+            float *o = in.dst + 3*(s0+i);
+            for( int c = 0; c < 3; c++)
+                o[c] = (q[c] + a*qW[c] + b*qW2[c]) + (v[c] + b*vW[c] + d*vW2[c]);
+        }
+    }
+}
+
+typedef void (*SkinKernel)( const SkinJob &, size_t, size_t);
+
+struct SkinKernels
+{
+    SkinKernel rigid, affine;
+};
+
+#define SKIN_KERNELS(NAME, ATTR)                                                                                  \
+    ATTR void NAME##Rigid( const SkinJob &job, size_t begin, size_t end)  { skinKernel<false>(job, begin, end); } \
+    ATTR void NAME##Affine( const SkinJob &job, size_t begin, size_t end) { skinKernel<true>(job, begin, end); }  \
+    const SkinKernels NAME##Kernels = { NAME##Rigid, NAME##Affine };
+
+SKIN_KERNELS(base, )
+
+#if defined(__x86_64__) || defined(__i386__)
+SKIN_KERNELS(avx2,   __attribute__((target("avx2,fma"))))
+SKIN_KERNELS(avx512, __attribute__((target("avx512f,fma"))))
+#endif
+
+const SkinKernels &getSkinKernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    switch( getFmaSimdLevel() ) {
+    case SimdLevel::AVX512: return avx512Kernels;
+    case SimdLevel::AVX2:   return avx2Kernels;
+    default: break;
+    }
+#endif
+    return baseKernels;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Skinning::apply( double t, const Mesh &src, Mesh &dst) const
+{
+    assert( weights.size() == src.getNumNodes() );
+    assert( dst.getNumNodes() == src.getNumNodes() );
+    assert( maxHandle < numHandles );
+
+    PROFILE_SCOPE("Skinning::apply");
+    PROFILE_COUNT("vertices skinned", src.getNumNodes());
+
+    if( numHandles == 0) {
+        dst.coords = src.coords;
+        return;
+    }
+
+    SkinJob job;
+    job.src = src.coords.data();
+    job.dst = dst.coords.data();
+    for( int k = 0; k < MAX_INFLUENCES; k++) {
+        job.handle[k] = weights.handle[k].data();
+        job.weight[k] = weights.weight[k].data();
+    }
+    for( int j = 0; j < 12; j++) job.logs[j] = logs[j].data();
+    job.t = t;
+
+    // The weights of a vertex sum to at most one, so no blended symmetric
+    // log is longer than |t| maxShear.
+    double norm = fabs(t)*maxShear;
+    job.squarings = 0;
+    job.scale     = 1.0;
+    while( norm > SHEAR_NORM) {
+        norm      *= 0.5;
+        job.scale *= 0.5;
+        job.squarings++;
+    }
+
+    SkinKernel kernel = maxShear > 0.0 ? getSkinKernels().affine : getSkinKernels().rigid;
+    ThreadPool::instance().parallelFor( src.getNumNodes(), VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        kernel( job, begin, end);
+    });
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "SteadyMotion.h"
+#include "Mesh.h"
+
+// Each vertex follows at most this many handles.
+const int MAX_INFLUENCES = 4;
+
+// Sparse skinning weights stored as a structure of arrays: influence k of
+// vertex v is handle[k][v] with weight[k][v]. The weights of a vertex are
+// nonnegative and sum to one, or are all zero for a vertex that stays put;
+// unused slots have weight zero and handle zero.
+
+struct SkinWeights
+{
+    std::vector<int>   handle[MAX_INFLUENCES];
+    std::vector<float> weight[MAX_INFLUENCES];
+
+    void   resize( size_t n);
+    size_t size() const { return handle[0].size(); }
+
+    // Keep the MAX_INFLUENCES largest positive weights of n (handle, weight)
+    // pairs and scale them to sum to one.
+    void set( size_t v, const int *handles, const float *weights, int n);
+
+    int getMaxHandle() const;
+};
+
+// Read one line per vertex of "handle weight" pairs; an empty line leaves
+// the vertex in place.
+bool readSkinWeights( const std::string &filename, size_t numVertices, SkinWeights &weights,
+                      std::string &errmsg);
+
+// Per-vertex blend of steady affine motions ("handles"). Handle i moves by
+// A_i(t) = [S_i^t 0; 0 1] B_i(t) as in SteadyMotion, so its logs at time t
+// are t log S_i and t log B_i. A vertex with weights w_i moves by
+//     A(t) = [exp(t sum w_i log S_i) 0; 0 1] expSE(t sum w_i log B_i),
+// the blending in log space of AffineLib; a vertex with all its weight on one
+// handle moves exactly with that handle.
+
+class Skinning
+{
+public:
+    void setHandles( const std::vector<SteadyMotion> &motions);
+
+    // Every handle with a nonzero weight must be below getNumHandles() when
+    // apply() is called.
+    void setWeights( const SkinWeights &w);
+
+    int  getNumHandles() const { return numHandles; }
+    const SkinWeights &getWeights() const { return weights; }
+
+    // Pose of vertex v at time t, evaluated with AffineLib.
+    Eigen::Matrix4d getMatrix( size_t v, double t) const;
+
+    // Write the positions of src at time t into dst, which must have as many
+    // vertices as there are weights. Normals are left alone. Runs the SIMD
+    // kernel on ThreadPool::instance().
+    void apply( double t, const Mesh &src, Mesh &dst) const;
+
+private:
+    // Handle logs as a structure of arrays: the symmetric log S entries xx,
+    // yy, zz, xy, xz, yz, then the upper entries (0,1), (0,2), (1,2) of the
+    // rotation block of log B and its translation.
+    std::vector<double> logs[12];
+    int    numHandles = 0;
+    double maxShear   = 0.0;     // largest spectral norm of a log S_i; 0 if all are rigid
+
+    SkinWeights weights;
+    int         maxHandle = -1;
+};
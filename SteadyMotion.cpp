@@ -0,0 +1,241 @@
+#include "SteadyMotion.h"
+#include "TransformKernel.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool SteadyMotion::readAffinityMatrix( const string &filename, string &errmsg)
+{
+    ifstream ifile( filename.c_str(), ios::in);
+    if( ifile.fail() ) {
+        errmsg = filename + ": cannot open file";
+        return 0;
+    }
+
+    Eigen::Matrix4d aa;
+    for( int i = 0; i < 4; i++)
+        ifile >> aa(i,0) >> aa(i,1) >> aa(i,2) >> aa(i,3);
+
+    if( ifile.fail() ) {
+        errmsg = filename + ": expected 16 matrix entries";
+        return 0;
+    }
+
+    if( aa.topLeftCorner<3,3>().determinant() <= 0.0) {
+        errmsg = filename + ": the matrix does not preserve orientation";
+        return 0;
+    }
+
+    setMatrix( aa.transpose() );   // Prof. Shizuo Kaji, the author of AfflineLib helped..
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void SteadyMotion::setMatrix( const Eigen::Matrix4d &mat)
+{
+    PROFILE_SCOPE("SteadyMotion::setMatrix");
+
+    A = mat;
+
+    // A = [S 0; 0 1] [R 0; l 1] with log S = U diag(mu) U^T.
+    Eigen::Matrix3d L = A.topLeftCorner<3,3>(), logS, R;
+    AffineLib::parametriseGL( L, logS, R);
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigensolver(logS);
+    shearBasis = eigensolver.eigenvectors();
+    shearLog   = eigensolver.eigenvalues();
+    shearing   = shearLog.cwiseAbs().maxCoeff() > EPSILON;
+
+    Eigen::Matrix4d B = AffineLib::pad( R, A.block<1,3>(3,0).transpose() );
+    screw.setLog( AffineLib::logSEc(B) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix3d SteadyMotion::getShear( double t) const
+{
+    if( !shearing) return Eigen::Matrix3d::Identity();
+
+    Eigen::Vector3d s = (t*shearLog).array().exp();
+    return shearBasis*s.asDiagonal()*shearBasis.transpose();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix4d SteadyMotion::getMatrix( double t) const
+{
+    Eigen::Matrix4d At = screw.evaluate(t);
+    if( shearing)
+        At.topLeftCorner<3,3>() = getShear(t)*At.topLeftCorner<3,3>();
+    return At;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MotionStepper::start( const SteadyMotion &m, double h, double tolerance)
+{
+    motion     = m;
+    dt         = h;
+    screwStep  = motion.getScrew().evaluate(dt);
+    shearStep  = motion.getShear(dt);
+
+    // Measure how fast the products drift from the closed form over a trial
+    // run, and assume that the error keeps growing linearly after it.
+    const long PROBE = 1024;
+    reset();
+    double rate = DBL_EPSILON;
+    for( long i = 1; i <= PROBE; i++) {
+        k = i;
+        advance();
+        if( (i & (i-1)) == 0)
+            rate = max(rate, getError()/i);
+    }
+
+    interval = max(1L, (long)min(tolerance/rate, 1.0e15));
+    reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MotionStepper::reset()
+{
+    k     = 0;
+    curr  = Eigen::Matrix4d::Identity();
+    screwCurr = Eigen::Matrix4d::Identity();
+    shearCurr = Eigen::Matrix3d::Identity();
+    numResyncs = 0;
+    maxError   = 0.0;
+    lastError  = 0.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+double MotionStepper::getError() const
+{
+    return (curr - motion.getMatrix(getTime())).cwiseAbs().maxCoeff();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MotionStepper::advance()
+{
+    // The shear and the screw are each steady on their own, so both advance
+    // by a constant step; only their product has to be formed anew.
+    screwCurr = screwCurr*screwStep;
+    curr      = screwCurr;
+    if( motion.isRigid() ) return;
+
+    shearCurr = shearCurr*shearStep;
+    curr.topLeftCorner<3,3>() = shearCurr*screwCurr.topLeftCorner<3,3>();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const Eigen::Matrix4d &MotionStepper::step()
+{
+    k++;
+    advance();
+
+    if( k % interval == 0) {
+        lastError = getError();
+        maxError  = max(maxError, lastError);
+        double t  = getTime();
+        screwCurr = motion.getScrew().evaluate(t);
+        shearCurr = motion.getShear(t);
+        curr      = motion.getMatrix(t);
+        numResyncs++;
+    }
+    return curr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void applyMotion( const Eigen::Matrix4d &At, const Mesh &src, Mesh &dst)
+{
+    assert( dst.getNumNodes() == src.getNumNodes() );
+
+    PROFILE_SCOPE("applyMotion");
+    PROFILE_COUNT("vertices transformed", src.getNumNodes());
+
+    // At acts on row vectors; repack it as a 3x4 matrix acting on columns.
+    float M[12];
+    for( int j = 0; j < 3; j++) {
+        M[4*j+0] = At(0,j);
+        M[4*j+1] = At(1,j);
+        M[4*j+2] = At(2,j);
+        M[4*j+3] = At(3,j);
+    }
+
+    const float *x = src.coords.data();
+    float       *y = dst.coords.data();
+    ThreadPool::instance().parallelFor( src.getNumNodes(), VERTEX_CHUNK, [&](size_t begin, size_t end) {
+        transformPoints( M, x + 3*begin, y + 3*begin, end - begin);
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void transformNormals( const float *M, bool renormalize, const MeshBuffer<float> &src,
+                              MeshBuffer<float> &dst, size_t chunk)
+{
+    dst.resize( src.size() );
+
+    const float *x = src.data();
+    float       *y = dst.data();
+    ThreadPool::instance().parallelFor( src.size()/3, chunk, [&](size_t begin, size_t end) {
+        transformPoints( M, x + 3*begin, y + 3*begin, end - begin);
+        if( !renormalize) return;
+        for( size_t i = begin; i < end; i++) {
+            float *n = y + 3*i;
+            float mag = sqrt( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+            if( mag > 0.0f) {
+                n[0] /= mag;
+                n[1] /= mag;
+                n[2] /= mag;
+            }
+        }
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void applyNormalMotion( const Eigen::Matrix4d &At, const Mesh &src, Mesh &dst)
+{
+    PROFILE_SCOPE("applyNormalMotion");
+
+    // Normals move with the inverse transpose of the linear part. For row
+    // vectors that is L^-T, i.e. L^-1 acting on columns, with no translation.
+    Eigen::Matrix3d N = At.topLeftCorner<3,3>().inverse();
+
+    // A similarity only scales all normals alike, which one factor undoes;
+    // shear or non-uniform scaling needs each normal rescaled.
+    Eigen::Matrix3d NtN = N.transpose()*N;
+    double scale = NtN.trace()/3.0;
+    bool   renormalize = (NtN - scale*Eigen::Matrix3d::Identity()).cwiseAbs().maxCoeff() > 1.0e-6*scale;
+    if( !renormalize) N /= sqrt(scale);
+
+    float M[12];
+    for( int j = 0; j < 3; j++) {
+        M[4*j+0] = N(j,0);
+        M[4*j+1] = N(j,1);
+        M[4*j+2] = N(j,2);
+        M[4*j+3] = 0.0f;
+    }
+
+    transformNormals( M, renormalize, src.normals, dst.normals, FACE_CHUNK);
+    PROFILE_COUNT("normals transformed", src.normals.size()/3);
+
+    if( src.vertexNormals.size() == src.coords.size() ) {
+        transformNormals( M, renormalize, src.vertexNormals, dst.vertexNormals, VERTEX_CHUNK);
+        PROFILE_COUNT("normals transformed", src.vertexNormals.size()/3);
+    }
+}
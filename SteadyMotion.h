@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+
+#include <Eigen/Dense>
+#include "affinelib.h"
+
+#include "ScrewMotion.h"
+
+#include "Mesh.h"
+
+// Steady affine motion A(t) between the identity and an affinity matrix A
+// with a positive determinant. The linear part of A is factored once as S R,
+// with S symmetric positive definite and R a rotation, and
+//     A(t) = [S^t 0; 0 1] B(t),
+// where B(t) is the screw motion from the identity to the rigid part
+// [R 0; l 1] and S^t = U exp(t diag(mu)) U^T uses the eigenbasis U of log S
+// found at load time. A pose costs three exponentials and one 3x3 product on
+// top of the screw, and for a rigid A it is exp(t log A). Matrices follow the
+// AffineLib convention of acting on row vectors by right multiplication.
+
+class SteadyMotion
+{
+public:
+    // Read the 4x4 matrix of a ".xf" file (acting on column vectors, one row
+    // per line) and set it as the end pose. Reflections are rejected.
+    bool readAffinityMatrix( const std::string &filename, std::string &errmsg);
+
+    // A must have a positive determinant.
+    void setMatrix( const Eigen::Matrix4d &A);
+
+    const Eigen::Matrix4d &getMatrix() const { return A; }
+
+    // Rigid part B(t).
+    const ScrewMotion     &getScrew()  const { return screw; }
+
+    // True when S is the identity up to rounding.
+    bool isRigid() const { return !shearing; }
+
+    // Eigenbasis U and eigenvalues mu of log S.
+    const Eigen::Matrix3d &getShearBasis() const { return shearBasis; }
+    const Eigen::Vector3d &getShearLog()   const { return shearLog; }
+
+    // S^t.
+    Eigen::Matrix3d getShear( double t) const;
+
+    // Pose at time t; A(0) is the identity and A(1) is A.
+    Eigen::Matrix4d getMatrix( double t) const;
+
+private:
+    Eigen::Matrix4d A    = Eigen::Matrix4d::Identity();
+    ScrewMotion     screw;
+    Eigen::Matrix3d shearBasis = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d shearLog   = Eigen::Vector3d::Zero();
+    bool            shearing   = 0;
+};
+
+// Poses A(k dt), k = 0, 1, ..., advanced by one product with the constant step
+// matrix B(dt) per step, and one more with S^dt if the motion shears. Rounding errors accumulate, so every
+// getResyncInterval() steps the pose is reset to the closed form; the interval
+// is chosen at start() so that the drift stays below the given tolerance.
+
+class MotionStepper
+{
+public:
+    void start( const SteadyMotion &motion, double dt, double tolerance = 1.0e-10);
+    void reset();
+
+    // Advance to the next step and return its pose.
+    const Eigen::Matrix4d &step();
+
+    const Eigen::Matrix4d &getMatrix() const { return curr; }
+    long   getStep() const { return k; }
+    double getTime() const { return k*dt; }
+
+    long   getResyncInterval() const { return interval; }
+    long   getNumResyncs()     const { return numResyncs; }
+
+    // Current difference from the closed form; costs one evaluation.
+    double getError() const;
+
+    // Largest difference from the closed form seen at a resync, and the
+    // difference at the last one.
+    double getMaxError()  const { return maxError; }
+    double getLastError() const { return lastError; }
+
+private:
+    SteadyMotion    motion;
+    Eigen::Matrix4d screwStep  = Eigen::Matrix4d::Identity();
+    Eigen::Matrix4d screwCurr  = Eigen::Matrix4d::Identity();
+    Eigen::Matrix3d shearStep  = Eigen::Matrix3d::Identity();
+    Eigen::Matrix3d shearCurr  = Eigen::Matrix3d::Identity();
+    Eigen::Matrix4d curr       = Eigen::Matrix4d::Identity();
+    double dt = 0.0;
+    long   k  = 0;
+    long   interval   = 1;
+    long   numResyncs = 0;
+    double maxError   = 0.0, lastError = 0.0;
+
+    void advance();
+};
+
+// Write the positions of src moved by At into dst, which must have as many
+// vertices. Runs the SIMD kernel on ThreadPool::instance().
+void applyMotion( const Eigen::Matrix4d &At, const Mesh &src, Mesh &dst);
+
+// Write the face normals of src, and its vertex normals if it has them, moved
+// by the inverse transpose of At into dst. For an orientation preserving At
+// this agrees with recomputing them from the moved positions.
+void applyNormalMotion( const Eigen::Matrix4d &At, const Mesh &src, Mesh &dst);
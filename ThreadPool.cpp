@@ -0,0 +1,140 @@
+#include "ThreadPool.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+
+ThreadPool &ThreadPool::instance()
+{
+    static ThreadPool pool( [] {
+        const char *env = getenv("SAM_THREADS");
+        return env ? atoi(env) : 0;
+    }() );
+    return pool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ThreadPool::ThreadPool( int nthreads)
+{
+    nextChunk = 0;
+    setNumThreads(nthreads);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::setNumThreads( int n)
+{
+    lock_guard<mutex> call(callMutex);
+
+    if( n <= 0) n = thread::hardware_concurrency();
+    if( n <= 0) n = 1;
+    if( n == numThreads && (int)workers.size() == n-1) return;
+
+    stopWorkers();
+    startWorkers(n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::startWorkers( int n)
+{
+    quit       = 0;
+    numThreads = n;
+    for( int i = 0; i < n-1; i++)
+        workers.emplace_back( [this] { workerLoop(); } );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::stopWorkers()
+{
+    {
+        lock_guard<mutex> lock(jobMutex);
+        quit = 1;
+    }
+    jobReady.notify_all();
+    for( auto &w : workers) w.join();
+    workers.clear();
+    numThreads = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::runChunks()
+{
+    size_t numChunks = (jobSize + jobChunk - 1)/jobChunk;
+    while(1) {
+        size_t c = nextChunk.fetch_add(1, memory_order_relaxed);
+        if( c >= numChunks) break;
+        size_t begin = c*jobChunk;
+        size_t end   = min(begin + jobChunk, jobSize);
+        (*jobFunc)(begin, end);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::workerLoop()
+{
+    size_t seen = 0;
+    while(1) {
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return quit || generation != seen; });
+            if( quit ) return;
+            seen = generation;
+        }
+
+        runChunks();
+
+        {
+            lock_guard<mutex> lock(jobMutex);
+            busy--;
+        }
+        jobDone.notify_one();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::parallelFor( size_t n, size_t chunk, const function<void(size_t,size_t)> &fn)
+{
+    if( n == 0) return;
+    if( chunk == 0) chunk = 1;
+
+    if( numThreads == 1 || n <= chunk) {
+        for( size_t begin = 0; begin < n; begin += chunk)
+            fn(begin, min(begin + chunk, n));
+        return;
+    }
+
+    lock_guard<mutex> call(callMutex);
+    {
+        lock_guard<mutex> lock(jobMutex);
+        jobFunc   = &fn;
+        jobSize   = n;
+        jobChunk  = chunk;
+        nextChunk = 0;
+        busy      = workers.size();
+        generation++;
+    }
+    jobReady.notify_all();
+
+    runChunks();
+
+    unique_lock<mutex> lock(jobMutex);
+    jobDone.wait(lock, [&] { return busy == 0; });
+    jobFunc = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+// Persistent pool of worker threads for the per-frame loops. The threads are
+// started once and sleep between jobs, so a frame does not pay for thread
+// creation. Work is handed out in fixed-size chunks; every element is
+// processed by exactly the same code as in a serial loop, so results do not
+// depend on the thread count.
+
+class ThreadPool
+{
+public:
+    // Shared pool used by the mesh and motion code. Its initial size is
+    // taken from the environment variable SAM_THREADS, or else from
+    // std::thread::hardware_concurrency().
+    static ThreadPool &instance();
+
+    explicit ThreadPool( int nthreads = 0);
+    ~ThreadPool();
+
+    ThreadPool( const ThreadPool &) = delete;
+    ThreadPool &operator=( const ThreadPool &) = delete;
+
+    // Total number of threads taking part in a job, including the caller.
+    // Setting it to 1 makes parallelFor() run serially.
+    void setNumThreads( int n);
+    int  getNumThreads() const { return numThreads; }
+
+    // Call fn(begin,end) for consecutive chunks of [0,n) of at most chunk
+    // elements each, and return when all of them are done. The calling
+    // thread takes chunks as well. Must not be called from inside fn.
+    void parallelFor( size_t n, size_t chunk, const std::function<void(size_t,size_t)> &fn);
+
+private:
+    void startWorkers( int n);
+    void stopWorkers();
+    void workerLoop();
+    void runChunks();
+
+    int numThreads = 1;
+    std::vector<std::thread> workers;
+
+    std::mutex              jobMutex;
+    std::mutex              callMutex;
+    std::condition_variable jobReady, jobDone;
+    bool     quit       = 0;
+    size_t   generation = 0;
+    int      busy       = 0;
+
+    const std::function<void(size_t,size_t)> *jobFunc = nullptr;
+    size_t jobSize  = 0;
+    size_t jobChunk = 0;
+    std::atomic<size_t> nextChunk;
+};
+
+// Chunk sizes for the per-frame loops, chosen so that the input and output of
+// one chunk stay within a typical L2 cache.
+const size_t VERTEX_CHUNK = 16384;
+const size_t FACE_CHUNK   = 8192;
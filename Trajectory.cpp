@@ -0,0 +1,117 @@
+#include "Trajectory.h"
+#include "SteadyMotion.h"
+#include "MeshIO.h"
+#include "Profile.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+const uint32_t SECTION_FRAME_TIMES    = FIRST_EXTRA_SECTION;
+const uint32_t SECTION_FRAME_MATRICES = FIRST_EXTRA_SECTION + 1;
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Trajectory::setMesh( const Mesh &src)
+{
+    mesh.clearTopology();
+    mesh.coords  = src.coords;
+    mesh.normals = src.normals;
+    mesh.shareConnectivity(src);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Trajectory::clearFrames()
+{
+    times.clear();
+    matrices.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Trajectory::addFrame( double t, const Eigen::Matrix4d &At)
+{
+    size_t k = times.size();
+    times.resize(k + 1);
+    matrices.resize(12*(k + 1));
+
+    times[k] = t;
+    double *m = matrices.data() + 12*k;
+    for( int r = 0; r < 4; r++)
+        for( int c = 0; c < 3; c++)
+            m[3*r+c] = At(r,c);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix4d Trajectory::getMatrix( size_t k) const
+{
+    const double *m = matrices.data() + 12*k;
+    Eigen::Matrix4d At;
+    for( int r = 0; r < 4; r++) {
+        for( int c = 0; c < 3; c++)
+            At(r,c) = m[3*r+c];
+        At(r,3) = r == 3 ? 1.0 : 0.0;
+    }
+    return At;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t Trajectory::findFrame( double t) const
+{
+    size_t k = upper_bound( times.begin(), times.end(), t) - times.begin();
+    return k > 0 ? k - 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Trajectory::getFrame( size_t k, Mesh &dst) const
+{
+    PROFILE_SCOPE("Trajectory::getFrame");
+
+    Eigen::Matrix4d At = getMatrix(k);
+    applyMotion( At, mesh, dst);
+    if( !mesh.normals.empty() )
+        applyNormalMotion( At, mesh, dst);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Trajectory::write( const string &filename, string &errmsg) const
+{
+    PROFILE_SCOPE("Trajectory::write");
+
+    return writeMeshCache( filename, mesh, errmsg, "",
+                           { {SECTION_FRAME_TIMES, &times}, {SECTION_FRAME_MATRICES, &matrices} });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Trajectory::read( const string &filename, string &errmsg)
+{
+    PROFILE_SCOPE("Trajectory::read");
+
+    Mesh m;
+    MeshBuffer<double> t, a;
+    if( !readMeshCache( filename, m, errmsg, "", { {SECTION_FRAME_TIMES, &t}, {SECTION_FRAME_MATRICES, &a} }))
+        return 0;
+
+    if( a.size() != 12*t.size() ) {
+        errmsg = filename + ": expected 12 matrix entries per frame";
+        return 0;
+    }
+
+    mesh.clearTopology();
+    mesh.coords  = std::move(m.coords);
+    mesh.normals = std::move(m.normals);
+    mesh.shareConnectivity(m);
+    times    = std::move(t);
+    matrices = std::move(a);
+    return 1;
+}
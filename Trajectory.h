@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+#include <Eigen/Dense>
+
+#include "Mesh.h"
+
+// Animation of a rigidly or affinely moving mesh stored as the source mesh
+// and one matrix per frame, instead of one copy of the geometry per frame.
+// A trajectory file is a mesh cache (see MeshIO.h) with two extra sections:
+// the frame times, and for every frame the 3x3 block of its matrix row by
+// row followed by the bottom row, in the AffineLib layout; the last column
+// is implied. Reading maps the mesh and both tables without copying, and any
+// frame is rebuilt from the source mesh with applyMotion.
+
+class Trajectory
+{
+public:
+    // Copy the positions and face normals of src and share its connectivity.
+    void setMesh( const Mesh &src);
+    const Mesh &getMesh() const { return mesh; }
+
+    void clearFrames();
+
+    // Frames may be added in any order of time, but findFrame() expects
+    // nondecreasing times.
+    void addFrame( double t, const Eigen::Matrix4d &At);
+
+    size_t getNumFrames() const { return times.size(); }
+    double getTime( size_t k) const { return times[k]; }
+    Eigen::Matrix4d getMatrix( size_t k) const;
+
+    // Last frame at or before time t, or the first one.
+    size_t findFrame( double t) const;
+
+    // Write the positions of frame k into dst, and its face normals if the
+    // mesh has them. dst must have as many vertices as the mesh.
+    void getFrame( size_t k, Mesh &dst) const;
+
+    // Both return false and a message in errmsg on failure. read() rejects a
+    // file whose triangles refer to vertices it does not have.
+    bool write( const std::string &filename, std::string &errmsg) const;
+    bool read( const std::string &filename, std::string &errmsg);
+
+private:
+    Mesh mesh;
+    MeshBuffer<double> times;
+    MeshBuffer<double> matrices;   // 12 per frame
+};
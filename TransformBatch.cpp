@@ -0,0 +1,357 @@
+#include "TransformBatch.h"
+#include "TransformKernel.h"
+#include "BatchMath.h"
+
+#include <cmath>
+
+using namespace std;
+
+// The kernels are written as plain loops over the lanes, without branches in
+// their bodies, and are compiled once for each instruction set so that the
+// compiler vectorizes them.
+
+namespace {
+
+using namespace BatchMath;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// atan of 0 <= x <= 1.
+BATCH_INLINE double atanUnit( double x)
+{
+    static const double P[] = {
+        -8.750608600031904122785E-1, -1.615753718733365076637E1,
+        -7.500855792314704667340E1,  -1.228866684490136173410E2,
+        -6.485021904942025371773E1 };
+    static const double Q[] = { 1.0,
+         2.485846490142306297962E1,   1.650270098316988542046E2,
+         4.328810604912902668951E2,   4.853903996359136964868E2,
+         1.945506571482613964425E2 };
+    const double MOREBITS = 6.123233995736765886130E-17;
+
+    bool   big  = x > 0.66;
+    double base = big ? M_PI/4 : 0.0;
+    x = big ? (x - 1.0)/(x + 1.0) : x;
+
+    double z = x*x;
+    z = z*polevl(z, P, 4)/polevl(z, Q, 5);
+    return base + (x*z + x) + (big ? 0.5*MOREBITS : 0.0);
+}
+
+// atan2 of y >= 0 and x, in [0, pi].
+BATCH_INLINE double atan2Upper( double y, double x)
+{
+    double ax  = fabs(x);
+    bool   steep = y > ax;
+    double num = steep ? ax : y;
+    double den = steep ? y  : ax;
+    double a   = atanUnit( num/(den > 0.0 ? den : 1.0) );
+
+    double r = steep ? M_PI/2 - a : a;
+    return x < 0.0 ? M_PI - r : r;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Pointers to the arrays of one batch.
+struct Lanes
+{
+    const double *m[9];
+    const double *l[3];
+
+    explicit Lanes( const TransformBatch &b) {
+        for( int k = 0; k < 9; k++) m[k] = b.m[k].data();
+        for( int k = 0; k < 3; k++) l[k] = b.l[k].data();
+    }
+};
+
+struct OutLanes
+{
+    double *m[9];
+    double *l[3];
+
+    OutLanes( TransformBatch &b, size_t n, bool rigid) {
+        for( int k = 0; k < 9; k++) {
+            b.m[k].resize(n);
+            m[k] = b.m[k].data();
+        }
+        for( int k = 0; k < 3; k++) {
+            if( rigid) b.l[k].resize(n);
+            l[k] = b.l[k].data();
+        }
+    }
+};
+
+BATCH_INLINE void square( const double *W, double *W2)
+{
+    for( int r = 0; r < 3; r++)
+        for( int c = 0; c < 3; c++)
+            W2[3*r+c] = W[3*r+0]*W[0+c] + W[3*r+1]*W[3+c] + W[3*r+2]*W[6+c];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// AffineLib::expSO and, with translations, AffineLib::expSE.
+template<bool SE>
+BATCH_INLINE void expKernel( const Lanes &lanes, OutLanes &outLanes, size_t n)
+{
+    // Local copies, which the stores cannot alias.
+    const Lanes in  = lanes;
+    OutLanes    out = outLanes;
+
+#pragma GCC ivdep
+    for( size_t i = 0; i < n; i++) {
+        double W[9], W2[9];
+        for( int k = 0; k < 9; k++) W[k] = in.m[k][i];
+        square(W, W2);
+
+        double a, b, d;
+        expSECoefficients( W[1]*W[1] + W[2]*W[2] + W[5]*W[5], a, b, d);
+
+        for( int k = 0; k < 9; k++)
+            out.m[k][i] = (k % 4 == 0 ? 1.0 : 0.0) + a*W[k] + b*W2[k];
+
+        if( SE) {
+            double v[3] = { in.l[0][i], in.l[1][i], in.l[2][i] };
+            for( int c = 0; c < 3; c++) {
+                double vW  = v[0]*W[c]  + v[1]*W[3+c]  + v[2]*W[6+c];
+                double vW2 = v[0]*W2[c] + v[1]*W2[3+c] + v[2]*W2[6+c];
+                out.l[c][i] = v[c] + b*vW + d*vW2;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// AffineLib::logSOc and, with translations, AffineLib::logSEc. prev holds the
+// logs whose branches are followed, or is null for the principal logs.
+template<bool SE, bool CONT>
+BATCH_INLINE void logKernel( const Lanes &lanes, const Lanes *prevLanes, OutLanes &outLanes, size_t n)
+{
+    const Lanes in   = lanes;
+    const Lanes prev = prevLanes ? *prevLanes : lanes;
+    OutLanes    out  = outLanes;
+
+#pragma GCC ivdep
+    for( size_t i = 0; i < n; i++) {
+        double M[9];
+        for( int k = 0; k < 9; k++) M[k] = in.m[k][i];
+
+        // Angle from the trace and the skew part w = sin(angle) axis.
+        double c0 = 0.5*(M[0] + M[4] + M[8] - 1.0);
+        c0 = c0 > 1.0 ? 1.0 : (c0 < -1.0 ? -1.0 : c0);
+        double w[3] = { 0.5*(M[7] - M[5]), 0.5*(M[2] - M[6]), 0.5*(M[3] - M[1]) };
+        double s0 = sqrt( w[0]*w[0] + w[1]*w[1] + w[2]*w[2] );
+        double angle = atan2Upper(s0, c0);
+
+        // Past a quarter turn the axis is better taken from the largest
+        // column of the symmetric part (M + M^T)/2 - cos I = (1-cos) n n^T.
+        double B[9];
+        for( int r = 0; r < 3; r++)
+            for( int c = 0; c < 3; c++)
+                B[3*r+c] = 0.5*(M[3*r+c] + M[3*c+r]) - (r == c ? c0 : 0.0);
+        double b48 = B[4] >= B[8] ? B[4] : B[8];
+        double col[3];
+        for( int j = 0; j < 3; j++)
+            col[j] = B[0] >= b48 ? B[3*j] : (B[4] >= B[8] ? B[3*j+1] : B[3*j+2]);
+        double cn = sqrt( col[0]*col[0] + col[1]*col[1] + col[2]*col[2] );
+        double cs = col[0]*w[0] + col[1]*w[1] + col[2]*w[2] < 0.0 ? -1.0 : 1.0;
+
+        bool   wide = c0 < 0.0;
+        double scale = wide ? cs/(cn > 0.0 ? cn : 1.0) : 1.0/(s0 > 0.0 ? s0 : 1.0);
+        double axis[3];
+        for( int j = 0; j < 3; j++) axis[j] = scale*(wide ? col[j] : w[j]);
+
+        double pn[3] = { 0.0, 0.0, 0.0 };
+        double prevTheta = 0.0;
+        if( CONT) {
+            pn[0] = -prev.m[5][i];
+            pn[1] =  prev.m[2][i];
+            pn[2] = -prev.m[1][i];
+            prevTheta = sqrt( pn[0]*pn[0] + pn[1]*pn[1] + pn[2]*pn[2] );
+
+            // As AngleAxis does for the identity, keep the previous axis.
+            for( int j = 0; j < 3; j++) axis[j] = angle == 0.0 ? pn[j] : axis[j];
+
+            // Turn the axis towards the previous one and move the angle to
+            // the branch within pi of the previous angle.
+            bool flip = axis[0]*pn[0] + axis[1]*pn[1] + axis[2]*pn[2] < 0.0;
+            for( int j = 0; j < 3; j++) axis[j] = flip ? -axis[j] : axis[j];
+            angle = flip ? -angle : angle;
+
+            double d = angle - prevTheta;
+            angle = prevTheta + d - 2.0*M_PI*roundNearest( d/(2.0*M_PI) );
+        }
+
+        double X[9] = {              0.0, -angle*axis[2],  angle*axis[1],
+                           angle*axis[2],            0.0, -angle*axis[0],
+                          -angle*axis[1],  angle*axis[0],            0.0 };
+        for( int j = 0; j < 9; j++) out.m[j][i] = X[j];
+
+        if( SE) {
+            double X2[9];
+            square(X, X2);
+
+            double theta2 = X[5]*X[5] + X[2]*X[2] + X[1]*X[1];
+            double theta  = sqrt(theta2);
+            double s, c;
+            sinCos(theta, s, c);
+
+            // Near the identity the series of e, as in AffineLib; the test
+            // for whole turns only applies past it. The flags are combined
+            // with & and | rather than && and ||, whose short circuits would
+            // keep the loop from vectorizing.
+            bool   small = theta2 < 1.0e-4;
+            bool   still = !small & (fabs(1.0 - c) < EPSILON);
+            bool   half  = fabs(1.0 + c) < EPSILON;
+            bool   flat  = small | still;
+            double t2 = flat ? 1.0 : theta2;
+            double st = half ? 1.0 : s*theta;
+            st = flat ? 1.0 : st;
+            double hc = half ? 0.0 : 0.5*(1.0 + c)/st;
+            double e  = 1.0/t2 - hc;
+            e = small ? 1.0/12.0 + theta2/720.0 + theta2*theta2/30240.0 : e;
+
+            // After whole turns AffineLib scales the previous translation,
+            // or keeps v without a previous rotation.
+            double ps = 0.0;
+            if( CONT) ps = theta/(prevTheta < EPSILON ? 1.0 : prevTheta);
+            bool keep = !CONT | (prevTheta < EPSILON);
+
+            // l = A^T v with A = I - X/2 + e X^2.
+            double v[3] = { in.l[0][i], in.l[1][i], in.l[2][i] };
+            for( int c = 0; c < 3; c++) {
+                double vX  = v[0]*X[c]  + v[1]*X[3+c]  + v[2]*X[6+c];
+                double vX2 = v[0]*X2[c] + v[1]*X2[3+c] + v[2]*X2[6+c];
+                double l   = v[c] - 0.5*vX + e*vX2;
+                double pl  = CONT ? prev.l[c][i] : 0.0;
+                double lp  = keep ? v[c] : ps*pl;
+                out.l[c][i] = still ? lp : l;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Kernels
+{
+    void (*expSO)( const Lanes &, OutLanes &, size_t);
+    void (*expSE)( const Lanes &, OutLanes &, size_t);
+    void (*logSO)( const Lanes &, const Lanes *, OutLanes &, size_t);
+    void (*logSE)( const Lanes &, const Lanes *, OutLanes &, size_t);
+    void (*logSOc)( const Lanes &, const Lanes *, OutLanes &, size_t);
+    void (*logSEc)( const Lanes &, const Lanes *, OutLanes &, size_t);
+};
+
+#define BATCH_KERNELS(NAME, ATTR)                                                                           \
+    ATTR void NAME##ExpSO( const Lanes &in, OutLanes &out, size_t n) { expKernel<false>(in, out, n); }       \
+    ATTR void NAME##ExpSE( const Lanes &in, OutLanes &out, size_t n) { expKernel<true>(in, out, n); }        \
+    ATTR void NAME##LogSO( const Lanes &in, const Lanes *p, OutLanes &out, size_t n)  { logKernel<false,false>(in, p, out, n); } \
+    ATTR void NAME##LogSE( const Lanes &in, const Lanes *p, OutLanes &out, size_t n)  { logKernel<true,false>(in, p, out, n); }  \
+    ATTR void NAME##LogSOc( const Lanes &in, const Lanes *p, OutLanes &out, size_t n) { logKernel<false,true>(in, p, out, n); }  \
+    ATTR void NAME##LogSEc( const Lanes &in, const Lanes *p, OutLanes &out, size_t n) { logKernel<true,true>(in, p, out, n); }   \
+    const Kernels NAME##Kernels = { NAME##ExpSO, NAME##ExpSE, NAME##LogSO, NAME##LogSE, NAME##LogSOc, NAME##LogSEc };
+
+BATCH_KERNELS(base, )
+
+#if defined(__x86_64__) || defined(__i386__)
+BATCH_KERNELS(avx2,   __attribute__((target("avx2,fma"))))
+BATCH_KERNELS(avx512, __attribute__((target("avx512f,fma"))))
+#endif
+
+const Kernels &getKernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    switch( getFmaSimdLevel() ) {
+    case SimdLevel::AVX512: return avx512Kernels;
+    case SimdLevel::AVX2:   return avx2Kernels;
+    default: break;
+    }
+#endif
+    return baseKernels;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TransformBatch::resize( size_t n)
+{
+    for( int k = 0; k < 9; k++) m[k].resize(n);
+    for( int k = 0; k < 3; k++) l[k].resize(n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TransformBatch::set( size_t i, const Eigen::Matrix4d &A)
+{
+    for( int k = 0; k < 9; k++) m[k][i] = A(k/3, k%3);
+    for( int k = 0; k < 3; k++) l[k][i] = A(3, k);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Matrix4d TransformBatch::get( size_t i, double br) const
+{
+    Eigen::Matrix4d A = Eigen::Matrix4d::Zero();
+    for( int k = 0; k < 9; k++) A(k/3, k%3) = m[k][i];
+    for( int k = 0; k < 3; k++) A(3, k) = l[k].empty() ? 0.0 : l[k][i];
+    A(3,3) = br;
+    return A;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void expSOBatch( const TransformBatch &logs, TransformBatch &R)
+{
+    size_t n = logs.size();
+    Lanes    in(logs);
+    OutLanes out(R, n, 0);
+    getKernels().expSO(in, out, n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void expSEBatch( const TransformBatch &logs, TransformBatch &A)
+{
+    size_t n = logs.size();
+    Lanes    in(logs);
+    OutLanes out(A, n, 1);
+    getKernels().expSE(in, out, n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void logSOcBatch( const TransformBatch &R, TransformBatch &logs, const TransformBatch *P)
+{
+    assert( !P || P->size() == R.size() );
+
+    size_t n = R.size();
+    Lanes    in(R);
+    OutLanes out(logs, n, 0);
+    if( P) {
+        Lanes prev(*P);
+        getKernels().logSOc(in, &prev, out, n);
+    } else {
+        getKernels().logSO(in, nullptr, out, n);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void logSEcBatch( const TransformBatch &A, TransformBatch &logs, const TransformBatch *P)
+{
+    assert( !P || P->size() == A.size() );
+
+    size_t n = A.size();
+    Lanes    in(A);
+    OutLanes out(logs, n, 1);
+    if( P) {
+        Lanes prev(*P);
+        getKernels().logSEc(in, &prev, out, n);
+    } else {
+        getKernels().logSE(in, nullptr, out, n);
+    }
+}
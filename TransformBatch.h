@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Dense>
+
+// Many rigid motions, or logs of rigid motions, stored as a structure of
+// arrays so that the batched kernels below can handle one transform per SIMD
+// lane. For transform i in the AffineLib layout (acting on row vectors),
+// entry (r,c) of the 3x3 block is m[3*r+c][i] and entry c of the bottom row
+// is l[c][i]. The last column is implied: (0,0,0,1) for a motion and zero
+// for a log.
+
+struct TransformBatch
+{
+    std::vector<double> m[9];
+    std::vector<double> l[3];
+
+    void   resize( size_t n);
+    size_t size() const { return m[0].size(); }
+
+    void set( size_t i, const Eigen::Matrix4d &A);
+
+    // br is the bottom right corner: 1 for a motion, 0 for a log.
+    Eigen::Matrix4d get( size_t i, double br = 1.0) const;
+};
+
+// Batched AffineLib::expSO, expSE, logSOc and logSEc. The small-angle and
+// half-turn cases of the scalar functions are selected per lane without
+// branches, and the sines, cosines and arctangents are evaluated by
+// polynomials that vectorize. The results agree with the scalar functions to
+// within about 1e-14 relative to their size, except for rotations of exactly
+// half a turn, where both signs of the axis are valid logs. The kernel is
+// chosen from getFmaSimdLevel(). The outputs are resized to the size of the
+// input; expSO and logSOc only read and write the 3x3 blocks.
+void expSOBatch( const TransformBatch &logs, TransformBatch &R);
+void expSEBatch( const TransformBatch &logs, TransformBatch &A);
+
+// The optional P holds, per transform, the log whose branch is to be followed.
+void logSOcBatch( const TransformBatch &R, TransformBatch &logs, const TransformBatch *P = nullptr);
+void logSEcBatch( const TransformBatch &A, TransformBatch &logs, const TransformBatch *P = nullptr);
@@ -0,0 +1,295 @@
+#include "TransformKernel.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAM_X86 1
+#endif
+
+// This file must be compiled with -ffp-contract=off; otherwise the compiler
+// may fuse the multiply-adds differently in each variant.
+
+////////////////////////////////////////////////////////////////////////////////
+
+void transformPointsScalar( const float *M, const float *src, float *dst, size_t n)
+{
+    for( size_t i = 0; i < n; i++) {
+        float x = src[3*i+0];
+        float y = src[3*i+1];
+        float z = src[3*i+2];
+        dst[3*i+0] = M[0]*x + M[1]*y + M[2]*z  + M[3];
+        dst[3*i+1] = M[4]*x + M[5]*y + M[6]*z  + M[7];
+        dst[3*i+2] = M[8]*x + M[9]*y + M[10]*z + M[11];
+    }
+}
+
+#ifdef SAM_X86
+
+// Each kernel works on groups of four points (twelve floats) per 128-bit lane.
+// The three registers m03, m14, m25 hold the floats [0,4), [4,8), [8,12) of
+// every group; in-lane shuffles turn them into x, y, z vectors and back.
+
+////////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("sse2")))
+static void transformPointsSSE2( const float *M, const float *src, float *dst, size_t n)
+{
+    __m128 a0 = _mm_set1_ps(M[0]), a1 = _mm_set1_ps(M[1]), a2  = _mm_set1_ps(M[2]),  a3 = _mm_set1_ps(M[3]);
+    __m128 b0 = _mm_set1_ps(M[4]), b1 = _mm_set1_ps(M[5]), b2  = _mm_set1_ps(M[6]),  b3 = _mm_set1_ps(M[7]);
+    __m128 c0 = _mm_set1_ps(M[8]), c1 = _mm_set1_ps(M[9]), c2  = _mm_set1_ps(M[10]), c3 = _mm_set1_ps(M[11]);
+
+    size_t nblock = n/4;
+    for( size_t i = 0; i < nblock; i++) {
+        const float *p = src + 12*i;
+        __m128 m03 = _mm_loadu_ps(p);
+        __m128 m14 = _mm_loadu_ps(p+4);
+        __m128 m25 = _mm_loadu_ps(p+8);
+
+        __m128 xy = _mm_shuffle_ps(m14, m25, _MM_SHUFFLE(2,1,3,2));
+        __m128 yz = _mm_shuffle_ps(m03, m14, _MM_SHUFFLE(1,0,2,1));
+        __m128 x  = _mm_shuffle_ps(m03, xy,  _MM_SHUFFLE(2,0,3,0));
+        __m128 y  = _mm_shuffle_ps(yz,  xy,  _MM_SHUFFLE(3,1,2,0));
+        __m128 z  = _mm_shuffle_ps(yz,  m25, _MM_SHUFFLE(3,0,3,1));
+
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a0,x), _mm_mul_ps(a1,y)), _mm_mul_ps(a2,z)), a3);
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(b0,x), _mm_mul_ps(b1,y)), _mm_mul_ps(b2,z)), b3);
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0,x), _mm_mul_ps(c1,y)), _mm_mul_ps(c2,z)), c3);
+
+        __m128 rxy = _mm_shuffle_ps(rx,  ry,  _MM_SHUFFLE(2,0,2,0));
+        __m128 ryz = _mm_shuffle_ps(ry,  rz,  _MM_SHUFFLE(3,1,3,1));
+        __m128 rzx = _mm_shuffle_ps(rz,  rx,  _MM_SHUFFLE(3,1,2,0));
+        __m128 r03 = _mm_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2,0,2,0));
+        __m128 r14 = _mm_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3,1,2,0));
+        __m128 r25 = _mm_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3,1,3,1));
+
+        float *q = dst + 12*i;
+        _mm_storeu_ps(q,   r03);
+        _mm_storeu_ps(q+4, r14);
+        _mm_storeu_ps(q+8, r25);
+    }
+
+    size_t done = 4*nblock;
+    transformPointsScalar(M, src + 3*done, dst + 3*done, n - done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx2")))
+static void transformPointsAVX2( const float *M, const float *src, float *dst, size_t n)
+{
+    __m256 a0 = _mm256_set1_ps(M[0]), a1 = _mm256_set1_ps(M[1]), a2 = _mm256_set1_ps(M[2]),  a3 = _mm256_set1_ps(M[3]);
+    __m256 b0 = _mm256_set1_ps(M[4]), b1 = _mm256_set1_ps(M[5]), b2 = _mm256_set1_ps(M[6]),  b3 = _mm256_set1_ps(M[7]);
+    __m256 c0 = _mm256_set1_ps(M[8]), c1 = _mm256_set1_ps(M[9]), c2 = _mm256_set1_ps(M[10]), c3 = _mm256_set1_ps(M[11]);
+
+    size_t nblock = n/8;
+    for( size_t i = 0; i < nblock; i++) {
+        const float *p = src + 24*i;
+        __m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)),   _mm_loadu_ps(p+12), 1);
+        __m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p+4)), _mm_loadu_ps(p+16), 1);
+        __m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p+8)), _mm_loadu_ps(p+20), 1);
+
+        __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2,1,3,2));
+        __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1,0,2,1));
+        __m256 x  = _mm256_shuffle_ps(m03, xy,  _MM_SHUFFLE(2,0,3,0));
+        __m256 y  = _mm256_shuffle_ps(yz,  xy,  _MM_SHUFFLE(3,1,2,0));
+        __m256 z  = _mm256_shuffle_ps(yz,  m25, _MM_SHUFFLE(3,0,3,1));
+
+        __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a0,x), _mm256_mul_ps(a1,y)), _mm256_mul_ps(a2,z)), a3);
+        __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b0,x), _mm256_mul_ps(b1,y)), _mm256_mul_ps(b2,z)), b3);
+        __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0,x), _mm256_mul_ps(c1,y)), _mm256_mul_ps(c2,z)), c3);
+
+        __m256 rxy = _mm256_shuffle_ps(rx,  ry,  _MM_SHUFFLE(2,0,2,0));
+        __m256 ryz = _mm256_shuffle_ps(ry,  rz,  _MM_SHUFFLE(3,1,3,1));
+        __m256 rzx = _mm256_shuffle_ps(rz,  rx,  _MM_SHUFFLE(3,1,2,0));
+        __m256 r03 = _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2,0,2,0));
+        __m256 r14 = _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3,1,2,0));
+        __m256 r25 = _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3,1,3,1));
+
+        float *q = dst + 24*i;
+        _mm_storeu_ps(q,    _mm256_castps256_ps128(r03));
+        _mm_storeu_ps(q+4,  _mm256_castps256_ps128(r14));
+        _mm_storeu_ps(q+8,  _mm256_castps256_ps128(r25));
+        _mm_storeu_ps(q+12, _mm256_extractf128_ps(r03, 1));
+        _mm_storeu_ps(q+16, _mm256_extractf128_ps(r14, 1));
+        _mm_storeu_ps(q+20, _mm256_extractf128_ps(r25, 1));
+    }
+
+    size_t done = 8*nblock;
+    transformPointsScalar(M, src + 3*done, dst + 3*done, n - done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx512f")))
+static inline __m512 loadLanes512( const float *p)
+{
+    __m512 r = _mm512_castps128_ps512(_mm_loadu_ps(p));
+    r = _mm512_insertf32x4(r, _mm_loadu_ps(p+12), 1);
+    r = _mm512_insertf32x4(r, _mm_loadu_ps(p+24), 2);
+    r = _mm512_insertf32x4(r, _mm_loadu_ps(p+36), 3);
+    return r;
+}
+
+__attribute__((target("avx512f")))
+static inline void storeLanes512( float *q, __m512 r)
+{
+    _mm_storeu_ps(q,    _mm512_castps512_ps128(r));
+    _mm_storeu_ps(q+12, _mm512_extractf32x4_ps(r, 1));
+    _mm_storeu_ps(q+24, _mm512_extractf32x4_ps(r, 2));
+    _mm_storeu_ps(q+36, _mm512_extractf32x4_ps(r, 3));
+}
+
+__attribute__((target("avx512f")))
+static void transformPointsAVX512( const float *M, const float *src, float *dst, size_t n)
+{
+    __m512 a0 = _mm512_set1_ps(M[0]), a1 = _mm512_set1_ps(M[1]), a2 = _mm512_set1_ps(M[2]),  a3 = _mm512_set1_ps(M[3]);
+    __m512 b0 = _mm512_set1_ps(M[4]), b1 = _mm512_set1_ps(M[5]), b2 = _mm512_set1_ps(M[6]),  b3 = _mm512_set1_ps(M[7]);
+    __m512 c0 = _mm512_set1_ps(M[8]), c1 = _mm512_set1_ps(M[9]), c2 = _mm512_set1_ps(M[10]), c3 = _mm512_set1_ps(M[11]);
+
+    size_t nblock = n/16;
+    for( size_t i = 0; i < nblock; i++) {
+        const float *p = src + 48*i;
+        __m512 m03 = loadLanes512(p);
+        __m512 m14 = loadLanes512(p+4);
+        __m512 m25 = loadLanes512(p+8);
+
+        __m512 xy = _mm512_shuffle_ps(m14, m25, _MM_SHUFFLE(2,1,3,2));
+        __m512 yz = _mm512_shuffle_ps(m03, m14, _MM_SHUFFLE(1,0,2,1));
+        __m512 x  = _mm512_shuffle_ps(m03, xy,  _MM_SHUFFLE(2,0,3,0));
+        __m512 y  = _mm512_shuffle_ps(yz,  xy,  _MM_SHUFFLE(3,1,2,0));
+        __m512 z  = _mm512_shuffle_ps(yz,  m25, _MM_SHUFFLE(3,0,3,1));
+
+        __m512 rx = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a0,x), _mm512_mul_ps(a1,y)), _mm512_mul_ps(a2,z)), a3);
+        __m512 ry = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(b0,x), _mm512_mul_ps(b1,y)), _mm512_mul_ps(b2,z)), b3);
+        __m512 rz = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(c0,x), _mm512_mul_ps(c1,y)), _mm512_mul_ps(c2,z)), c3);
+
+        __m512 rxy = _mm512_shuffle_ps(rx,  ry,  _MM_SHUFFLE(2,0,2,0));
+        __m512 ryz = _mm512_shuffle_ps(ry,  rz,  _MM_SHUFFLE(3,1,3,1));
+        __m512 rzx = _mm512_shuffle_ps(rz,  rx,  _MM_SHUFFLE(3,1,2,0));
+        __m512 r03 = _mm512_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2,0,2,0));
+        __m512 r14 = _mm512_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3,1,2,0));
+        __m512 r25 = _mm512_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3,1,3,1));
+
+        float *q = dst + 48*i;
+        storeLanes512(q,   r03);
+        storeLanes512(q+4, r14);
+        storeLanes512(q+8, r25);
+    }
+
+    size_t done = 16*nblock;
+    transformPointsScalar(M, src + 3*done, dst + 3*done, n - done);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+static SimdLevel detectSimdLevel()
+{
+    SimdLevel level = SimdLevel::Scalar;
+#ifdef SAM_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("sse2"))    level = SimdLevel::SSE2;
+    if( __builtin_cpu_supports("avx2"))    level = SimdLevel::AVX2;
+    if( __builtin_cpu_supports("avx512f")) level = SimdLevel::AVX512;
+#endif
+
+    const char *env = getenv("SAM_SIMD");
+    if( env ) {
+        SimdLevel cap = level;
+        if( strcmp(env, "scalar") == 0) cap = SimdLevel::Scalar;
+        if( strcmp(env, "sse2")   == 0) cap = SimdLevel::SSE2;
+        if( strcmp(env, "avx2")   == 0) cap = SimdLevel::AVX2;
+        if( strcmp(env, "avx512") == 0) cap = SimdLevel::AVX512;
+        if( cap < level) level = cap;
+    }
+    return level;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SimdLevel getMaxSimdLevel()
+{
+    static const SimdLevel maxLevel = detectSimdLevel();
+    return maxLevel;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+AffineKernel getAffineKernel( SimdLevel level)
+{
+    if( level > getMaxSimdLevel() ) level = getMaxSimdLevel();
+
+#ifdef SAM_X86
+    switch( level ) {
+    case SimdLevel::AVX512: return transformPointsAVX512;
+    case SimdLevel::AVX2:   return transformPointsAVX2;
+    case SimdLevel::SSE2:   return transformPointsSSE2;
+    default: break;
+    }
+#endif
+    return transformPointsScalar;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<int> currLevel(-1);
+
+SimdLevel getSimdLevel()
+{
+    int level = currLevel.load(std::memory_order_relaxed);
+    if( level < 0) return getMaxSimdLevel();
+    return static_cast<SimdLevel>(level);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool detectFma()
+{
+#ifdef SAM_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma");
+#else
+    return 0;
+#endif
+}
+
+SimdLevel getFmaSimdLevel()
+{
+    static const bool hasFma = detectFma();
+    SimdLevel level = getSimdLevel();
+    return hasFma || level < SimdLevel::SSE2 ? level : SimdLevel::SSE2;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void setSimdLevel( SimdLevel level)
+{
+    if( level > getMaxSimdLevel() ) level = getMaxSimdLevel();
+    currLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void transformPoints( const float *M, const float *src, float *dst, size_t n)
+{
+    getAffineKernel( getSimdLevel() )(M, src, dst, n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *getSimdName( SimdLevel level)
+{
+    switch( level ) {
+    case SimdLevel::SSE2:   return "sse2";
+    case SimdLevel::AVX2:   return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    default: break;
+    }
+    return "scalar";
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+// Batched affine transform of packed xyz float positions.
+//
+// The matrix M is a row-major 3x4 matrix acting on column vectors:
+//     x' = M[0]*x + M[1]*y + M[2]*z  + M[3]
+//     y' = M[4]*x + M[5]*y + M[6]*z  + M[7]
+//     z' = M[8]*x + M[9]*y + M[10]*z + M[11]
+//
+// All variants evaluate these sums in the same order without fused
+// multiply-add, so every SIMD level gives bit-identical results to the
+// scalar fallback. src and dst may be the same array.
+
+enum class SimdLevel { Scalar = 0, SSE2, AVX2, AVX512 };
+
+typedef void (*AffineKernel)( const float *M, const float *src, float *dst, size_t n);
+
+// Transform n points with the currently selected kernel.
+void transformPoints( const float *M, const float *src, float *dst, size_t n);
+
+// Reference implementation used for the tails of the SIMD kernels.
+void transformPointsScalar( const float *M, const float *src, float *dst, size_t n);
+
+// Best level supported by this CPU. Setting the environment variable
+// SAM_SIMD to scalar, sse2, avx2 or avx512 caps it at startup.
+SimdLevel getMaxSimdLevel();
+
+SimdLevel getSimdLevel();
+
+// Level for kernels that are built with fused multiply-add on top of AVX2 or
+// AVX-512: getSimdLevel(), lowered to SSE2 on a CPU without FMA.
+SimdLevel getFmaSimdLevel();
+
+// Select a kernel; requests above getMaxSimdLevel() are clamped.
+void setSimdLevel( SimdLevel level);
+
+AffineKernel getAffineKernel( SimdLevel level);
+
+const char *getSimdName( SimdLevel level);
@@ -10,6 +10,12 @@
  *           The convention used here is different from the one in the paper;
  *           we assume that matrices act on row vectors by right multiplication.
  *           ( that is, everything is transposed compared to the paper. )
+ * @section Scalar types
+ *           Every function is a template on the scalar type T of its Eigen
+ *           arguments. Small values are compared against Limits<T>::epsilon(),
+ *           which is EPSILON for double. float is meant for evaluating poses
+ *           each frame; the logs, eigen solvers and polar decompositions are
+ *           better done in double and converted once.
  * @version 0.30
  * @date  Jun. 2016
  * @author Shizuo KAJI
@@ -30,6 +36,7 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <limits>
 
 
 /// threshold for small values to be regarded zero
@@ -48,10 +55,34 @@ using namespace std;
 /// For vecterization of Eigen objects
 EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Matrix4d);
 EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Vector4d);
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Matrix4f);
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Vector4f);
 
 // main body
 namespace AffineLib{
-    inline Matrix4d pad(const Matrix3d& m, const Vector3d& l, const double br=1.0)
+    template<typename T> using Mat3 = Matrix<T,3,3>;
+    template<typename T> using Mat4 = Matrix<T,4,4>;
+    template<typename T> using Vec3 = Matrix<T,3,1>;
+    template<typename T> using Vec4 = Matrix<T,4,1>;
+    template<typename T> using RowVec4 = Matrix<T,1,4>;
+
+    /// the type T itself, in a parameter that does not take part in template argument deduction
+    template<typename T> struct identity { typedef T type; };
+
+    template<typename T> struct Limits;
+
+    template<> struct Limits<double>{
+        /// threshold for small values to be regarded zero
+        static double epsilon(){ return EPSILON; }
+    };
+
+    template<> struct Limits<float>{
+        /// threshold for small values to be regarded zero
+        static float epsilon(){ return 1.0e-6f; }
+    };
+
+    template<typename T>
+    inline Mat4<T> pad(const Mat3<T>& m, const typename identity<Vec3<T>>::type& l, const typename identity<T>::type br=1)
     /** compose an affine matrix from linear matrix and translation vector
      * @param m 3x3-matrix
      * @param l 3-dim translation vector
@@ -59,61 +90,65 @@ namespace AffineLib{
      * @return 4x4-affine transformation matrix
      */
     {
-        Matrix4d aff;
-        aff << m(0,0),m(0,1),m(0,2),0.0,
-        m(1,0),m(1,1),m(1,2),0.0,
-        m(2,0),m(2,1),m(2,2),0.0,
+        Mat4<T> aff;
+        aff << m(0,0),m(0,1),m(0,2),0,
+        m(1,0),m(1,1),m(1,2),0,
+        m(2,0),m(2,1),m(2,2),0,
         l[0],l[1],l[2],br;
         return aff;
     }
     
-    inline RowVector4d pad(const Vector3d& v)
+    template<typename T>
+    inline RowVec4<T> pad(const Vec3<T>& v)
     /** compose a 4-vector by concatenating 1 at the 4th coordinate
      * @param v 3-vector
      * @return 4-vector
      */
     {
-        return RowVector4d(v[0],v[1],v[2],1);
+        return RowVec4<T>(v[0],v[1],v[2],1);
     }
 
-    inline Vector3d transPart(const Matrix4d& m){
+    template<typename T>
+    inline Vec3<T> transPart(const Mat4<T>& m){
         /** extract the translation vector from an affine matrix
          * @param m affine matrix
          * @return 3D translation vector
          */
-        return Vector3d(m(3,0),m(3,1),m(3,2));
+        return Vec3<T>(m(3,0),m(3,1),m(3,2));
     }
     
-    inline Matrix3d logSO(const Matrix3d& m)
+    template<typename T>
+    inline Mat3<T> logSO(const Mat3<T>& m)
     /** Log for a rotational matrix using Axis-Angle
      * @param m rotational matrix
      * @return primary value of log(m)
      */
     {
-        assert( (m*m.transpose()-Id3).squaredNorm() < TOLERANCE );
-        AngleAxisd X(m);
-        Matrix3d A;
+        assert( (m*m.transpose()-Mat3<T>::Identity()).squaredNorm() < TOLERANCE );
+        AngleAxis<T> X(m);
+        Mat3<T> A;
         A << 0,     -X.axis()[2], X.axis()[1],
         X.axis()[2], 0,        -X.axis()[0],
         -X.axis()[1], X.axis()[0], 0;
         return X.angle() * A;
     }
 
-    inline Matrix3d logSOc(const Matrix3d& m, const Matrix3d& P)
+    template<typename T>
+    inline Mat3<T> logSOc(const Mat3<T>& m, const typename identity<Mat3<T>>::type& P)
     /** "Continuous" log for a rotational matrix
      * @param m rotational matrix
      * @param P anti-symmetric matrix
      * @return the branch of log(m) closest to P
      */
     {
-        assert( (m*m.transpose()-Id3).squaredNorm() < TOLERANCE );
-        AngleAxisd X(m);
-        Matrix3d A;
-        double theta=X.angle();
-        Vector3d n=X.axis();
-        Vector3d prevN(-P(1,2),P(0,2),-P(0,1));
-        double prevTheta=prevN.norm();
-        if(abs(sin(theta))==0.0){
+        assert( (m*m.transpose()-Mat3<T>::Identity()).squaredNorm() < TOLERANCE );
+        AngleAxis<T> X(m);
+        Mat3<T> A;
+        T theta=X.angle();
+        Vec3<T> n=X.axis();
+        Vec3<T> prevN(-P(1,2),P(0,2),-P(0,1));
+        T prevTheta=prevN.norm();
+        if(abs(sin(theta))==0){
             n=prevN;
         }
         A << 0,     -n[2], n[1],
@@ -123,119 +158,329 @@ namespace AffineLib{
             A = -A;
             theta = -theta;
         }
-        while(theta-prevTheta>M_PI){
-            theta -= 2*M_PI;
+        while(theta-prevTheta>T(M_PI)){
+            theta -= 2*T(M_PI);
         }
-        while(prevTheta-theta>M_PI){
-            theta += 2*M_PI;
+        while(prevTheta-theta>T(M_PI)){
+            theta += 2*T(M_PI);
         }
         return(theta*A);
     }
     
-    inline Matrix3d expTaylor(const Matrix3d& m, const int deg = 50)
+    template<typename T>
+    inline Mat3<T> expTaylor(const Mat3<T>& m, const int deg = 50)
         /** exp by Taylor expansion
          * @param m 3x3 matrix
          * @param deg degree of Taylor expansion
          * @return exp(m)
+         * @see expPade, which is faster and stays accurate for large norms
          */
     {
-        Matrix3d A = Id3;
-        Matrix3d mPow = Id3;
+        Mat3<T> A = Mat3<T>::Identity();
+        Mat3<T> mPow = Mat3<T>::Identity();
         for(int i=1;i<deg+1;i++){
-            mPow = m*mPow/i;
+            mPow = m*mPow/T(i);
             A += mPow;
         }
         return A;
     }
 
-    inline Matrix3d logTaylor(const Matrix3d& m, const int deg=50)
+    template<typename T>
+    inline Mat3<T> logTaylor(const Mat3<T>& m, const int deg=50)
     /** log by Taylor expansion
      * @param m 3x3 matrix
      * @param deg degree of Taylor expansion
      * @return log(m)
+     * @see logPade, which converges for any m without eigenvalues on the negative real axis
      */
     {
-        Matrix3d A = Matrix3d::Zero();
-        Matrix3d mPow = -Id3;
+        Mat3<T> A = Mat3<T>::Zero();
+        Mat3<T> mPow = -Mat3<T>::Identity();
         for(int i=1;i<deg+1;i++){
-            mPow = (Id3-m)*mPow;
-            A += mPow/i;
+            mPow = (Mat3<T>::Identity()-m)*mPow;
+            A += mPow/T(i);
         }
         return A;
     }
 
+
+    template<typename Derived>
+    inline typename Derived::Scalar norm1(const MatrixBase<Derived>& m)
+    /** operator 1-norm
+     * @param m square matrix
+     * @return largest absolute column sum of m
+     */
+    {
+        return m.cwiseAbs().colwise().sum().maxCoeff();
+    }
+
+    template<typename T> struct PadeExp;
+
+    template<> struct PadeExp<double>{
+        /// orders of the diagonal Pade approximants to exp and the largest 1-norms
+        /// for which they are accurate to double precision (Higham 2005)
+        static constexpr int count = 5;
+        static constexpr int order[count] = { 3, 5, 7, 9, 13 };
+        static constexpr double theta[count] = { 1.495585217958292e-2, 2.539398330063230e-1,
+            9.504178996162932e-1, 2.097847961257068e0, 5.371920351148152e0 };
+    };
+
+    template<> struct PadeExp<float>{
+        /// the same for single precision
+        static constexpr int count = 3;
+        static constexpr int order[count] = { 3, 5, 7 };
+        static constexpr float theta[count] = { 4.258730016922831e-1f, 1.880152677804762e0f,
+            3.925724783138660e0f };
+    };
+
+    template<typename T, int N>
+    inline Matrix<T,N,N> expPade(const Matrix<T,N,N>& m)
+    /** exp by a diagonal Pade approximant with scaling and squaring;
+     *  the order is the lowest one accurate to the precision of T for the 1-norm of m
+     * @param m square matrix
+     * @return exp(m)
+     */
+    {
+        typedef Matrix<T,N,N> Mat;
+        // numerator coefficients of the [13/13] approximant; those of the
+        // lower orders are listed in the same way below
+        static const double b3[]  = { 120, 60, 12, 1 };
+        static const double b5[]  = { 30240, 15120, 3360, 420, 30, 1 };
+        static const double b7[]  = { 17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1 };
+        static const double b9[]  = { 17643225600., 8821612800., 2075673600., 302702400., 30270240.,
+            2162160., 110880., 3960., 90., 1. };
+        static const double b13[] = { 64764752532480000., 32382376266240000., 7771770303897600.,
+            1187353796428800., 129060195264000., 10559470521600., 670442572800., 33522128640.,
+            1323241920., 40840800., 960960., 16380., 182., 1. };
+
+        const long n = m.rows();
+        const Mat I = Mat::Identity(n,n);
+        const int last = PadeExp<T>::count - 1;
+        T norm = norm1(m);
+
+        int k = 0;
+        while(k < last && norm > PadeExp<T>::theta[k]) k++;
+        int s = 0;
+        if(norm > PadeExp<T>::theta[last]){
+            s = int(ceil(log2(norm / PadeExp<T>::theta[last])));
+        }
+        Mat X = m / T(ldexp(1.0, s));
+
+        int order = PadeExp<T>::order[k];
+        const double *b = order == 3 ? b3 : order == 5 ? b5 : order == 7 ? b7 : order == 9 ? b9 : b13;
+
+        // N(X) = V + U and D(X) = V - U with V even and U odd in X; both are
+        // evaluated by Horner's rule in X^2
+        Mat X2 = X*X;
+        Mat V = T(b[order-1]) * I;
+        Mat U = T(b[order]) * I;
+        for(int j=order-3;j>=0;j-=2){
+            V = X2*V + T(b[j]) * I;
+            U = X2*U + T(b[j+1]) * I;
+        }
+        U = X*U;
+        Mat R = (V-U).inverse() * (V+U);
+        for(int i=0;i<s;i++){
+            R = R*R;
+        }
+        return R;
+    }
+
+    template<typename T> struct PadeLog{
+        /// highest order of the Pade approximants to log(1+x)
+        static const int max_order = 8;
+
+        /// Gauss-Legendre nodes and weights on [0,1] for each order; then
+        /// log(I+X) ~ sum_j weight[j] X (I + node[j] X)^{-1}
+        double node[max_order+1][max_order];
+        double weight[max_order+1][max_order];
+        /// largest 1-norm of X for which each order is accurate to the precision of T
+        double theta[max_order+1];
+
+        static const PadeLog& get(){
+            static const PadeLog table;
+            return table;
+        }
+
+    private:
+        PadeLog(){
+            for(int m=1;m<=max_order;m++){
+                // Newton's method on the Legendre polynomial P_m
+                long double x_[max_order], w_[max_order];
+                for(int i=0;i<m;i++){
+                    long double z = cos(M_PI*(i+0.75)/(m+0.5)), dp = 1;
+                    for(int it=0;it<100;it++){
+                        long double p1 = 1, p2 = 0;
+                        for(int j=1;j<=m;j++){
+                            long double p3 = p2;
+                            p2 = p1;
+                            p1 = ((2*j-1)*z*p2 - (j-1)*p3)/j;
+                        }
+                        dp = m*(z*p1-p2)/(z*z-1);
+                        long double dz = p1/dp;
+                        z -= dz;
+                        if(fabsl(dz) < 1e-18L) break;
+                    }
+                    x_[i] = (1+z)/2;
+                    w_[i] = 1/((1-z*z)*dp*dp);
+                    node[m][i] = double(x_[i]);
+                    weight[m][i] = double(w_[i]);
+                }
+                // the error of the matrix approximant is bounded by that of the
+                // scalar one at -||X|| (Kenney and Laub); bisect for the norm at
+                // which the latter reaches the unit roundoff
+                long double u = std::numeric_limits<T>::epsilon()/2;
+                long double lo = 0, hi = 0.99;
+                for(int it=0;it<60;it++){
+                    long double x = (lo+hi)/2, r = 0;
+                    for(int i=0;i<m;i++) r -= w_[i]*x/(1-x_[i]*x);
+                    long double err = fabsl(r - log1pl(-x));
+                    if(err <= u*fabsl(log1pl(-x))) lo = x; else hi = x;
+                }
+                theta[m] = double(lo);
+            }
+        }
+    };
+
+    template<typename T, int N>
+    inline Matrix<T,N,N> logPade(const Matrix<T,N,N>& m)
+    /** log by a Pade approximant with inverse scaling and squaring;
+     *  square roots are taken until m is close enough to the identity for an
+     *  approximant of order at most PadeLog<T>::max_order, and the lowest such order is used
+     * @param m square matrix with no eigenvalues on the closed negative real axis;
+     *        the square roots lose accuracy when m is far from normal and its
+     *        condition number is beyond about 1e6
+     * @return principal log(m)
+     */
+    {
+        typedef Matrix<T,N,N> Mat;
+        const PadeLog<T>& table = PadeLog<T>::get();
+        const int max_order = PadeLog<T>::max_order;
+        const long n = m.rows();
+        const Mat I = Mat::Identity(n,n);
+
+        Mat A = m;
+        int s = 0;
+        while(norm1(A-I) > table.theta[max_order] && s < 64){
+            // product form of the Denman-Beavers iteration for the square
+            // root; M tends to the identity and Y to the root of A
+            Mat Y = A, M = A;
+            for(int it=0;it<100;it++){
+                Mat Mi = M.inverse();
+                Y = Y * (I + Mi) / T(2);
+                M = (I + (M + Mi) / T(2)) / T(2);
+                if(norm1(M-I) <= std::numeric_limits<T>::epsilon() * n) break;
+            }
+            A = Y;
+            s++;
+        }
+
+        Mat X = A-I;
+        T norm = norm1(X);
+        int order = 1;
+        while(order < max_order && norm > table.theta[order]) order++;
+
+        Mat L = Mat::Zero(n,n);
+        for(int j=0;j<order;j++){
+            L += T(table.weight[order][j]) * (I + T(table.node[order][j]) * X).inverse() * X;
+        }
+        return T(ldexp(1.0, s)) * L;
+    }
     
-    inline Matrix3d expSO(const Matrix3d& m)
+    template<typename T>
+    inline void rodriguesCoeffs(T norm2, T& a, T& b, T& c)
+    /** coefficients sin(x)/x, (1-cos(x))/x^2 and (x-sin(x))/x^3 of the exponentials
+     * at x = sqrt(norm2), from their series below x = 1e-2 where the closed forms cancel
+     * @param norm2 squared rotation angle
+     */
+    {
+        if(norm2 < T(1.0e-4)){
+            a = 1 - norm2/6 + norm2*norm2/120;
+            b = T(0.5) - norm2/24 + norm2*norm2/720;
+            c = T(1)/6 - norm2/120 + norm2*norm2/5040;
+        }else{
+            T norm = sqrt(norm2);
+            T h = sin(norm/2);
+            a = sin(norm)/norm;
+            b = 2*h*h/norm2;
+            c = (norm-sin(norm))/(norm*norm2);
+        }
+    }
+
+    template<typename T>
+    inline Mat3<T> expSO(const Mat3<T>& m)
     /** exp for an anti-symmetric matrix using Rodrigues' formula
      * @param m anti-symmetric matrix
      * @return exp(m)
      */
     {
         assert( ((m + m.transpose())).squaredNorm() < TOLERANCE );
-        double norm2=m(0,1)*m(0,1) + m(0,2)*m(0,2) + m(1,2)*m(1,2);
-        if(norm2<EPSILON){
-            return Id3 + m + m*m/2.0;
-        }else{
-            double norm = sqrt(norm2);
-            return Id3 + sin(norm)/norm * m + (1.0-cos(norm))/norm2 * m*m;
-        }
+        T norm2=m(0,1)*m(0,1) + m(0,2)*m(0,2) + m(1,2)*m(1,2);
+        T a,b,c;
+        rodriguesCoeffs(norm2, a, b, c);
+        return Mat3<T>::Identity() + a * m + b * m*m;
     }
     
-    inline Matrix4d expSE(const Matrix4d& mm)
+    template<typename T>
+    inline Mat4<T> expSE(const Mat4<T>& mm)
     /** exp for the log of a rigid transformation (screw) matrix
      * @param mm the log of a rigid transformation matrix
      * @return exp(mm)
      */
     {
-        Matrix3d m = mm.block(0,0,3,3);
+        Mat3<T> m = mm.block(0,0,3,3);
         assert( ((m + m.transpose())).squaredNorm() < TOLERANCE );
-        Vector3d v;
+        Vec3<T> v;
         v << mm(3,0), mm(3,1), mm(3,2);
-        double norm2=m(0,1)*m(0,1) + m(0,2)*m(0,2) + m(1,2)*m(1,2);
-        Matrix3d A,ans;
-        if(norm2<EPSILON){
-            return (Matrix4d::Identity() + mm + mm*mm/2.0);
-        }else{
-            double norm = sqrt(norm2);
-            ans = Id3 + sin(norm)/norm * m + (1.0-cos(norm))/norm2 * m*m;
-            A = Id3 + (1.0-cos(norm))/norm2 * m + (norm-sin(norm))/(norm*norm2) * m*m ;
-            return pad(ans, A.transpose()*v);
-        }
+        T norm2=m(0,1)*m(0,1) + m(0,2)*m(0,2) + m(1,2)*m(1,2);
+        T a,b,c;
+        rodriguesCoeffs(norm2, a, b, c);
+        Mat3<T> ans = Mat3<T>::Identity() + a * m + b * m*m;
+        Mat3<T> A = Mat3<T>::Identity() + b * m + c * m*m;
+        return pad(ans, A.transpose()*v);
     }
     
-    inline Matrix4d logSEc(const Matrix4d& mm, const Matrix4d& P = Matrix4d::Zero())
+    template<typename T>
+    inline Mat4<T> logSEc(const Mat4<T>& mm, const typename identity<Mat4<T>>::type& P = Mat4<T>::Zero())
     /** "Continuous" log for a rigid transformation (screw) matrix
      * @param mm rigid transformation matrix
      * @param P log matrix
      * @return branch of log(mm) closest to P
      */
     {
-        Matrix3d m = mm.block(0,0,3,3);
-        assert( ((m * m.transpose()) - Id3).squaredNorm() < TOLERANCE );
-        Vector3d v = transPart(mm);
-        Matrix3d X = logSOc(m, P.block(0,0,3,3));
-        double theta=sqrt(X(1,2)*X(1,2) + X(0,2)*X(0,2) + X(0,1)*X(0,1));
-        Matrix3d A;
-        Vector3d l;
-        if(abs(1-cos(theta))<EPSILON){
-            double prevTheta = sqrt(P(1,2)*P(1,2) + P(0,2)*P(0,2) + P(0,1)*P(0,1));
-            if( prevTheta < EPSILON ){
-                l = Vector3d::Zero();
+        Mat3<T> m = mm.block(0,0,3,3);
+        assert( ((m * m.transpose()) - Mat3<T>::Identity()).squaredNorm() < TOLERANCE );
+        Vec3<T> v = transPart(mm);
+        Mat3<T> X = logSOc(m, P.block(0,0,3,3));
+        T theta2=X(1,2)*X(1,2) + X(0,2)*X(0,2) + X(0,1)*X(0,1);
+        T theta=sqrt(theta2);
+        Mat3<T> A;
+        Vec3<T> l;
+        if(theta2 < T(1.0e-4)){
+            // series of the coefficient below, which cancels for small angles
+            A = Mat3<T>::Identity() - T(0.5) * X + (T(1)/12 + theta2/720 + theta2*theta2/30240) * X*X;
+            l = A.transpose()*v;
+        }else if(abs(1-cos(theta))<Limits<T>::epsilon()){
+            // whole turns: keep the pitch of P
+            T prevTheta = sqrt(P(1,2)*P(1,2) + P(0,2)*P(0,2) + P(0,1)*P(0,1));
+            if( prevTheta < Limits<T>::epsilon() ){
+                l = v;
             }else{
-                l = theta / prevTheta * transPart(P);
+                l = theta / prevTheta * transPart<T>(P);
             }
-        }else if(abs(1+cos(theta))<EPSILON){
-            A = Id3 - 0.5 * X + 1.0/(theta*theta) * X*X;
+        }else if(abs(1+cos(theta))<Limits<T>::epsilon()){
+            A = Mat3<T>::Identity() - T(0.5) * X + 1/(theta*theta) * X*X;
             l = A.transpose()*v;
         }else{
-            A = Id3 - 0.5 * X + (1.0/(theta*theta) - 0.5*(1.0+cos(theta))/(sin(theta)*theta)) * X * X;
+            A = Mat3<T>::Identity() - T(0.5) * X + (1/(theta*theta) - T(0.5)*(1+cos(theta))/(sin(theta)*theta)) * X * X;
             l = A.transpose()*v;
         }
-        return(pad(X, l,0.0));
+        return(pad(X, l, 0));
     }
     
     
-    inline Matrix3d logDiag(const Matrix3d& U, const Vector3d& s)
+    template<typename T>
+    inline Mat3<T> logDiag(const Mat3<T>& U, const Vec3<T>& s)
     /** log for a diagonalised matrix  m = U diag(s) U^t with positive eigenvalues
      * @param U rotational diagonalising matrix
      * @param s eigenvalues (must be all positive)
@@ -243,58 +488,63 @@ namespace AffineLib{
      */
     {
         assert( s[0] > 0 && s[1] > 0 && s[2] > 0);
-        Vector3d d = s.array().log();
+        Vec3<T> d = s.array().log();
         return(U* d.asDiagonal() *U.transpose());
     }
     
-    inline Matrix3d expDiag(const Matrix3d& U, const Vector3d& s)
+    template<typename T>
+    inline Mat3<T> expDiag(const Mat3<T>& U, const Vec3<T>& s)
     /** exp for a diagonalised matrix  m = U diag(s) U^{-1}
      * @param U diagonalising matrix
      * @param s eigenvalues
      * @return exp(m)
      */
     {
-        Vector3d d = s.array().exp();
+        Vec3<T> d = s.array().exp();
         return(U* d.asDiagonal() *U.inverse());
     }
     
-    inline Matrix3d expSymDiag(const Matrix3d& m)
+    template<typename T>
+    inline Mat3<T> expSymDiag(const Mat3<T>& m)
     /** exp for a symmetric matrix by diagonalization
      * @param m symmetric matrix
      * @return exp(m)
      */
     {
         assert( ((m - m.transpose())).squaredNorm() < TOLERANCE );
-        if (m.squaredNorm() < EPSILON){
-            return Id3+m+0.5*m*m;
+        if (m.squaredNorm() < Limits<T>::epsilon()){
+            return Mat3<T>::Identity()+m+T(0.5)*m*m;
         }
-        SelfAdjointEigenSolver<Matrix3d> eigensolver;
+        SelfAdjointEigenSolver<Mat3<T>> eigensolver;
         eigensolver.compute(m);
-        Vector3d s(eigensolver.eigenvalues());
-        Matrix3d U(eigensolver.eigenvectors());
+        Vec3<T> s(eigensolver.eigenvalues());
+        Mat3<T> U(eigensolver.eigenvectors());
         s = s.array().exp();
         return(U * s.asDiagonal() * U.transpose());
     }
     
-    inline Matrix3d logSymDiag(const Matrix3d& m)
+    template<typename T>
+    inline Mat3<T> logSymDiag(const Mat3<T>& m)
     /** log for a symmetric matrix by diagonalization
      * @param m symmetric matrix
      * @return log(m)
      */
     {
         assert( ((m - m.transpose())).squaredNorm() < TOLERANCE );
-        if ((m-Id3).squaredNorm() < EPSILON){
-            return m-Id3-0.5*(m-Id3)*(m-Id3);
+        const Mat3<T> I = Mat3<T>::Identity();
+        if ((m-I).squaredNorm() < Limits<T>::epsilon()){
+            return m-I-T(0.5)*(m-I)*(m-I);
         }
-        SelfAdjointEigenSolver<Matrix3d> eigensolver;
+        SelfAdjointEigenSolver<Mat3<T>> eigensolver;
         eigensolver.compute(m);
-        Vector3d s(eigensolver.eigenvalues());
-        Matrix3d U(eigensolver.eigenvectors());
+        Vec3<T> s(eigensolver.eigenvalues());
+        Mat3<T> U(eigensolver.eigenvectors());
         s = s.array().log();
         return(U * s.asDiagonal() * U.transpose());
     }
     
-    inline Matrix3d expSym(const Matrix3d& m, Vector3d e=Vector3d::Zero())
+    template<typename T>
+    inline Mat3<T> expSym(const Mat3<T>& m, typename identity<Vec3<T>>::type e=Vec3<T>::Zero())
     /** exp for a symmetric matrix by spectral decomposition
      * @param m symmetric matrix
      * @param e if eigenvalues of m are provided, we use it
@@ -302,10 +552,12 @@ namespace AffineLib{
      */
     {
         assert( ((m - m.transpose())).squaredNorm() < TOLERANCE );
-        if(e == Vector3d::Zero()){
+        const T eps = Limits<T>::epsilon();
+        const Mat3<T> I = Mat3<T>::Identity();
+        if(e == Vec3<T>::Zero()){
             // compute eigenvalues if not given
             // eigenvalues are sorted in increasing order.
-            SelfAdjointEigenSolver<Matrix3d> eigensolver;
+            SelfAdjointEigenSolver<Mat3<T>> eigensolver;
             eigensolver.computeDirect(m, EigenvaluesOnly);
             e = eigensolver.eigenvalues();
             if(abs(e[0])<TOLERANCE){
@@ -313,22 +565,23 @@ namespace AffineLib{
                 e = eigensolver.eigenvalues();
             }
         }
-        Matrix3d A = m-e[1]*Id3;
-        if (A.squaredNorm() < EPSILON){
-            return exp(e[1])*(Id3+A+0.5*A*A);
+        Mat3<T> A = m-e[1]*I;
+        if (A.squaredNorm() < eps){
+            return exp(e[1])*(I+A+T(0.5)*A*A);
         }
-        double x(e[0]-e[1]),y(e[2]-e[1]);
-        double t2ex = abs(x)>EPSILON ? (exp(x)-1-x)/(x*x) : 0.5+x/6+x*x/24;
-        double t2ey = abs(y)>EPSILON ? (exp(y)-1-y)/(y*y) : 0.5+y/6+y*y/24;
+        T x(e[0]-e[1]),y(e[2]-e[1]);
+        T t2ex = abs(x)>eps ? (exp(x)-1-x)/(x*x) : T(0.5)+x/6+x*x/24;
+        T t2ey = abs(y)>eps ? (exp(y)-1-y)/(y*y) : T(0.5)+y/6+y*y/24;
         
-        double b = 1- x*y*(t2ex-t2ey)/(x-y);
-        double c = (x*t2ex- y*t2ey)/(x-y);
-        Matrix3d ans(exp(e[1])*( Id3 + b*A + c*A*A));
-        return (ans+ans.transpose())/2;
+        T b = 1- x*y*(t2ex-t2ey)/(x-y);
+        T c = (x*t2ex- y*t2ey)/(x-y);
+        Mat3<T> ans(exp(e[1])*( I + b*A + c*A*A));
+        return (ans+ans.transpose())/T(2);
     }
     
     
-    inline Matrix3d logSym(const Matrix3d& m, Vector3d& lambda)
+    template<typename T>
+    inline Mat3<T> logSym(const Mat3<T>& m, Vec3<T>& lambda)
     /** log for a positive definite symmetric matrix by spectral decomposition
      * @param m symmetric matrix
      * @param lambda returns eigen values for log(m)
@@ -336,34 +589,36 @@ namespace AffineLib{
      */
     {
         assert( ((m - m.transpose())).squaredNorm() < TOLERANCE );
+        const T eps = Limits<T>::epsilon();
         // compute eigenvalues only
         // eigenvalues are sorted in the increasing order.
-        SelfAdjointEigenSolver<Matrix3d> eigensolver;
+        SelfAdjointEigenSolver<Mat3<T>> eigensolver;
         eigensolver.computeDirect(m, EigenvaluesOnly);
-        Vector3d e(eigensolver.eigenvalues());
+        Vec3<T> e(eigensolver.eigenvalues());
         if(abs(e[0])<TOLERANCE){
             eigensolver.compute(m, EigenvaluesOnly);
             e = eigensolver.eigenvalues();
         }
         assert(e[0] > 0 && e[1] > 0 && e[2] > 0);
         lambda = e.array().log();
-        double x(e[0]/e[1]),y(e[2]/e[1]);
-        double t2lx = abs(x-1)>EPSILON ? (log(x)-x+1)/(x-1) : -(x-1)/2+(x-1)*(x-1)/3;
-        double t2ly = abs(y-1)>EPSILON ? (log(y)-y+1)/(y-1) : -(y-1)/2+(y-1)*(y-1)/3;
-        double a,c;
-        if(abs(x-y)>EPSILON){
+        T x(e[0]/e[1]),y(e[2]/e[1]);
+        T t2lx = abs(x-1)>eps ? (log(x)-x+1)/(x-1) : -(x-1)/2+(x-1)*(x-1)/3;
+        T t2ly = abs(y-1)>eps ? (log(y)-y+1)/(y-1) : -(y-1)/2+(y-1)*(y-1)/3;
+        T a,c;
+        if(abs(x-y)>eps){
             a = -1 + (y*t2lx - x*t2ly)/(x-y);
             c = (t2lx - t2ly)/(x-y);
         }else{
             a = -1/6 + x*y/3;
-            c = -0.5 + (x+y)/3;
+            c = T(-0.5) + (x+y)/3;
         }
-        Matrix3d ans((a+log(e[1]))*Id3 - (a+c)/e[1]*m + c/(e[1]*e[1])*m*m);
-        return (ans+ans.transpose())/2;
+        Mat3<T> ans((a+log(e[1]))*Mat3<T>::Identity() - (a+c)/e[1]*m + c/(e[1]*e[1])*m*m);
+        return (ans+ans.transpose())/T(2);
     }
     
     
-    inline Matrix3d frechetSO(const std::vector<Matrix3d> &m, const std::vector<double> &w, const int max_step=10)
+    template<typename T>
+    inline Mat3<T> frechetSO(const std::vector<Mat3<T>> &m, const std::vector<double> &w, const int max_step=10)
     /** the Frechet mean for rotations
      * @param m array of rotation matrices to be averaged
      * @param w array of weights
@@ -372,23 +627,24 @@ namespace AffineLib{
      */
     {
         assert(m.size() == w.size());
-        if(m.empty()) return(Id3);
-        Matrix3d Z = m[0];
+        if(m.empty()) return(Mat3<T>::Identity());
+        Mat3<T> Z = m[0];
         for(int i=0;i<max_step;i++){
-            Matrix3d W = Matrix3d::Zero();
-            Matrix3d ZI = Z.transpose();
+            Mat3<T> W = Mat3<T>::Zero();
+            Mat3<T> ZI = Z.transpose();
             for(int j=0;j<m.size();j++){
-                W += w[j] * logSO(ZI * m[j]);
+                W += T(w[j]) * logSO<T>(ZI * m[j]);
             }
-            W = (W-W.transpose())/2;
-            if(W.squaredNorm()<EPSILON) break;
+            W = (W-W.transpose())/T(2);
+            if(W.squaredNorm()<Limits<T>::epsilon()) break;
             Z = Z * expSO(W);
         }
         return(Z);
     }
     
     
-    inline Matrix3d frechetSym(const std::vector<Matrix3d> &m, const std::vector<double> &w, const int max_step=10)
+    template<typename T>
+    inline Mat3<T> frechetSym(const std::vector<Mat3<T>> &m, const std::vector<double> &w, const int max_step=10)
     /** the Frechet mean for symmetric matrices
      * @param m array of positive definite symmetric matrices to be averaged
      * @param w array of weights
@@ -397,23 +653,24 @@ namespace AffineLib{
      */
     {
         assert(m.size() == w.size());
-        if(m.empty()) return(Id3);
-        Vector3d e;
-        Matrix3d Z = m[0];
+        if(m.empty()) return(Mat3<T>::Identity());
+        Vec3<T> e;
+        Mat3<T> Z = m[0];
         for(int i=0;i<max_step;i++){
-            Matrix3d W = Matrix3d::Zero();
-            Matrix3d ZI = Z.inverse();
+            Mat3<T> W = Mat3<T>::Zero();
+            Mat3<T> ZI = Z.inverse();
             for(int j=0;j<m.size();j++){
-                W += w[j] * logSym(ZI * m[j], e);
+                W += T(w[j]) * logSym<T>(ZI * m[j], e);
             }
-            W = (W+W.transpose())/2;
-            if(W.squaredNorm()<EPSILON) break;
+            W = (W+W.transpose())/T(2);
+            if(W.squaredNorm()<Limits<T>::epsilon()) break;
             Z = Z * expSO(W);
         }
         return(Z);
     }
     
-    inline void polarDiag(const Matrix3d& m, Matrix3d& U, Vector3d& s, Matrix3d& R)
+    template<typename T>
+    inline void polarDiag(const Mat3<T>& m, Mat3<T>& U, Vec3<T>& s, Mat3<T>& R)
     /** Polar decomposition m = U diag(s) U^T R by diagonalisation
      * @param m matrix to be decomposed
      * @param U diagonaliser of symmetric part
@@ -422,79 +679,83 @@ namespace AffineLib{
      */
     {
         assert(m.determinant()>0);
-        Matrix3d A= m*m.transpose();
-        SelfAdjointEigenSolver<Matrix3d> eigensolver;
+        Mat3<T> A= m*m.transpose();
+        SelfAdjointEigenSolver<Mat3<T>> eigensolver;
         eigensolver.computeDirect(A);
         s = eigensolver.eigenvalues();
-        U = Matrix3d(eigensolver.eigenvectors());
+        U = Mat3<T>(eigensolver.eigenvectors());
         s = s.array().sqrt();
-        Vector3d si = s.array().inverse();
+        Vec3<T> si = s.array().inverse();
         R = U * si.asDiagonal() * U.transpose() * m;
     }
     
-    inline void polarN(const MatrixXf& m, MatrixXf& S, MatrixXf& R)
-    /** Polar decomposition m = S R for square matrix of any size
+    template<typename T, int N>
+    inline void polarN(const Matrix<T,N,N>& m, Matrix<T,N,N>& S, Matrix<T,N,N>& R)
+    /** Polar decomposition m = S R for square matrix of any size;
+     *  for a fixed size such as Matrix3d or Matrix4f nothing is allocated on the heap
      * @param m matrix to be decomposed
      * @param S symmetric part
      * @param R rotation part
      */
     {
+        typedef Matrix<T,N,N> Mat;
+        typedef Matrix<T,N,1> Vec;
         assert(m.determinant()>0);
-        MatrixXf A= m*m.transpose();
-        long N = A.rows();
-        SelfAdjointEigenSolver<MatrixXf> eigensolver;
+        Mat A= m*m.transpose();
+        long n = A.rows();
+        SelfAdjointEigenSolver<Mat> eigensolver;
         eigensolver.compute(A, EigenvaluesOnly);
-        VectorXf s = eigensolver.eigenvalues();
-        MatrixXf VM = MatrixXf::Zero(N,N);
-        double ss;
-        for(int i=0;i<N; i++){
-            ss = 1.0;
-            for(int j=0;j<N; j++){
+        Vec s = eigensolver.eigenvalues();
+        Mat VM = Mat::Zero(n,n);
+        T ss;
+        for(int i=0;i<n; i++){
+            ss = 1;
+            for(int j=0;j<n; j++){
                 VM(i,j) = ss;
                 ss *= s[i];
             }
         }
         // compute logS
-        VectorXf logs = s.array().log();
-        VectorXf a = VM.colPivHouseholderQr().solve(logs);
-        MatrixXf logS = MatrixXf::Zero(N,N);
-        MatrixXf AA = MatrixXf::Identity(N,N);
-        for(int i=0;i<N; i++){
+        Vec logs = s.array().log();
+        Vec a = VM.colPivHouseholderQr().solve(logs);
+        Mat logS = Mat::Zero(n,n);
+        Mat AA = Mat::Identity(n,n);
+        for(int i=0;i<n; i++){
             logS += a[i] * AA;
             AA *= A;
         }
-        logS /= 2.0;
+        logS /= T(2);
         // compute S
-        s = logs/2.0;
-        for(int i=0;i<N; i++){
-            ss = 1.0;
-            for(int j=0;j<N; j++){
+        s = logs/T(2);
+        for(int i=0;i<n; i++){
+            ss = 1;
+            for(int j=0;j<n; j++){
                 VM(i,j) = ss;
                 ss *= s[i];
             }
         }
-        VectorXf exps = s.array().exp();
-        VectorXf b = VM.colPivHouseholderQr().solve(exps);
-        S = MatrixXf::Zero(N,N);
-        AA = MatrixXf::Identity(N,N);
-        for(int i=0;i<N; i++){
+        Vec exps = s.array().exp();
+        Vec b = VM.colPivHouseholderQr().solve(exps);
+        S = Mat::Zero(n,n);
+        AA = Mat::Identity(n,n);
+        for(int i=0;i<n; i++){
             S += b[i] * AA;
             AA *= logS;
         }
         // compute R
         s = -s;
-        for(int i=0;i<N; i++){
-            ss = 1.0;
-            for(int j=0;j<N; j++){
+        for(int i=0;i<n; i++){
+            ss = 1;
+            for(int j=0;j<n; j++){
                 VM(i,j) = ss;
                 ss *= s[i];
             }
         }
-        VectorXf expsinv = exps.array().inverse();
-        VectorXf c = VM.colPivHouseholderQr().solve(expsinv);
-        MatrixXf SINV = MatrixXf::Zero(N,N);
-        AA = MatrixXf::Identity(N,N);
-        for(int i=0;i<N; i++){
+        Vec expsinv = exps.array().inverse();
+        Vec c = VM.colPivHouseholderQr().solve(expsinv);
+        Mat SINV = Mat::Zero(n,n);
+        AA = Mat::Identity(n,n);
+        for(int i=0;i<n; i++){
             SINV += c[i] * AA;
             AA *= -logS;
         }
@@ -502,59 +763,63 @@ namespace AffineLib{
     }
     
     
-    inline void polarBySVD(const Matrix3d& m, Matrix3d& U, Vector3d& s, Matrix3d& R){
+    template<typename T>
+    inline void polarBySVD(const Mat3<T>& m, Mat3<T>& U, Vec3<T>& s, Mat3<T>& R){
         /** Polar decomposition m = U diag(s) U^T R  by SVD
          * @param m matrix to be decomposed
          * @param U diagonaliser of symmetric part
          * @param s singular values
          * @param R rotation part
          */
-        JacobiSVD<Matrix3d> svd(m, ComputeFullU | ComputeFullV);
+        JacobiSVD<Mat3<T>> svd(m, ComputeFullU | ComputeFullV);
         U = svd.matrixU();
         s = svd.singularValues();
         R = svd.matrixU() * svd.matrixV().transpose();
     }
     
-    inline void polarByParam(const Matrix3d& m, Matrix3d& S, Matrix3d& R){
+    template<typename T>
+    inline void polarByParam(const Mat3<T>& m, Mat3<T>& S, Mat3<T>& R){
         /** Polar decomposition m = S R   by parametrisation map
          * @param m matrix to be decomposed
          * @param S shear part
          * @param R rotation part
          */
-        Vector3d lambda=Vector3d::Zero().eval();
-        Matrix3d logS = logSym(m*m.transpose(), lambda)/2.0;
-        S = expSym(logS, lambda/2.0);
-        R = expSym(-logS, -lambda/2.0) * m;
+        Vec3<T> lambda=Vec3<T>::Zero().eval();
+        Mat3<T> logS = logSym<T>(m*m.transpose(), lambda)/T(2);
+        S = expSym(logS, lambda/T(2));
+        R = expSym<T>(-logS, -lambda/T(2)) * m;
     }
     
-    inline int polarHigham(const Matrix3d& m, Matrix3d& S, Matrix3d& R){
+    template<typename T>
+    inline int polarHigham(const Mat3<T>& m, Mat3<T>& S, Mat3<T>& R){
         /** Polar decomposition m = S R   by Higham's iterative method
          * @param m matrix to be decomposed
          * @param S shear part
          * @param R rotation part
          * @return number of iterations
          */
-        Matrix3d Curr = m;
-        Matrix3d Prev;
+        Mat3<T> Curr = m;
+        Mat3<T> Prev;
         int iter=0;
         do {
-            assert(Curr.determinant() != 0.0);
-            Matrix3d Ad = Curr.inverse().transpose();
-            double nad = Ad.array().abs().colwise().sum().maxCoeff() * Ad.array().abs().rowwise().sum().maxCoeff();
-            double na = Curr.array().abs().colwise().sum().maxCoeff() * Curr.array().abs().rowwise().sum().maxCoeff();
-            double gamma = sqrt(sqrt(nad / na));
+            assert(Curr.determinant() != 0);
+            Mat3<T> Ad = Curr.inverse().transpose();
+            T nad = Ad.array().abs().colwise().sum().maxCoeff() * Ad.array().abs().rowwise().sum().maxCoeff();
+            T na = Curr.array().abs().colwise().sum().maxCoeff() * Curr.array().abs().rowwise().sum().maxCoeff();
+            T gamma = sqrt(sqrt(nad / na));
             //        std::cout << gamma << std::endl;
             Prev = Curr;
-            Curr = (0.5*gamma)*Curr + (0.5/gamma) *Ad;
+            Curr = (T(0.5)*gamma)*Curr + (T(0.5)/gamma) *Ad;
             iter++;
-        } while ((Prev-Curr).lpNorm<1>() > EPSILON*Prev.lpNorm<1>());
+        } while ((Prev-Curr).template lpNorm<1>() > Limits<T>::epsilon()*Prev.template lpNorm<1>());
         R = Curr;
         S = m * Curr.transpose();
         return iter;
     }
     
 
-    inline void parametriseGL(const Matrix3d& m, Matrix3d& logS, Matrix3d& R)
+    template<typename T>
+    inline void parametriseGL(const Mat3<T>& m, Mat3<T>& logS, Mat3<T>& R)
     /** Parametrisation map for GL(3)
      * @param m linear matrix to be decomposed
      * @param logS log of shear part
@@ -562,11 +827,10 @@ namespace AffineLib{
      */
     {
         assert(m.determinant()>0);
-        Vector3d lambda=Vector3d::Zero();
-        logS = logSym(m*m.transpose(), lambda)/2.0;
-        R = expSym(-logS, -lambda/2.0) * m;
+        Vec3<T> lambda=Vec3<T>::Zero();
+        logS = logSym<T>(m*m.transpose(), lambda)/T(2);
+        R = expSym<T>(-logS, -lambda/T(2)) * m;
     }
-    
     template<typename T>
     T blendMat(const std::vector<T>& A, const std::vector<double>& weight){
     /** blend matrices
@@ -601,7 +865,8 @@ namespace AffineLib{
         return X;
     }
     
-    inline Vector4d blendQuat(const std::vector<Vector4d>& A, const std::vector<double>& weight){
+    template<typename T>
+    inline Vec4<T> blendQuat(const std::vector<Vec4<T>>& A, const std::vector<double>& weight){
         /** blend 4-vector (quaternion); if weight doesn't sum up to one, the result will be complimented by 1
          * this is suitable for linear blending of quaternions
          * @param A list of 4-vectors
@@ -609,14 +874,14 @@ namespace AffineLib{
          * @return blended 4-vector
          */
         assert(A.size() == weight.size());
-        Vector4d I(0,0,0,1);
-        Vector4d X=Vector4d::Zero();
+        Vec4<T> I(0,0,0,1);
+        Vec4<T> X=Vec4<T>::Zero();
         double sum = 0.0;
         for(int i=0;i<A.size();i++){
-            X += weight[i] * A[i];
+            X += T(weight[i]) * A[i];
             sum += weight[i];
         }
-        X += (1.0-sum) * I;
+        X += T(1.0-sum) * I;
         return X.normalized();
     }
 }
@@ -0,0 +1,269 @@
+#include "SteadyMotion.h"
+#include "KeyframeMotion.h"
+#include "Skinning.h"
+#include "Trajectory.h"
+#include "MeshIO.h"
+#include "Profile.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+// Headless frame generator: writes the poses A(k/nsteps), k = 0..nsteps, of a
+// mesh as OBJ files without creating a window. With a drift tolerance the poses
+// are advanced incrementally by a MotionStepper instead of evaluated one by one.
+// With -skin every vertex follows its own blend of several handle motions. A
+// ".kf" keyframe file instead of the ".xf" matrix samples the whole chain. An
+// output name ending in ".traj" stores the mesh once and one matrix per frame
+// instead of the OBJ files, and -frame rebuilds a single frame from it.
+
+static void usage( const char *prog)
+{
+    cout << "Usage: " << prog << " mesh.off model.xf nsteps outdir [tolerance]" << endl;
+    cout << "       " << prog << " mesh.off path.kf nsteps outdir" << endl;
+    cout << "       " << prog << " mesh.off model.xf|path.kf nsteps out.traj" << endl;
+    cout << "       " << prog << " -frame in.traj k out.obj" << endl;
+    cout << "       " << prog << " -skin weights.txt mesh.off nsteps outdir handle.xf ..." << endl;
+}
+
+static void reportTimes( const Mesh &mesh, int nframes, double computeTime, double writeTime)
+{
+    double nvertices = double(nframes)*mesh.getNumNodes();
+    cout << "Frames     : " << nframes << " of " << mesh.getNumNodes() << " vertices" << endl;
+    cout << "Compute    : " << computeTime << " s, " << nframes/computeTime << " frames/s, "
+         << nvertices/computeTime*1.0e-6 << " Mvertices/s" << endl;
+    cout << "Write      : " << writeTime << " s, " << nframes/writeTime << " frames/s" << endl;
+    cout << "Total      : " << nframes/(computeTime + writeTime) << " frames/s" << endl;
+}
+
+typedef chrono::steady_clock Clock;
+
+static int skinFrames( int argc, char **argv)
+{
+    if( argc < 7) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    string weightfile = argv[2];
+    string meshfile   = argv[3];
+    int    nsteps     = atoi(argv[4]);
+    string outdir     = argv[5];
+
+    if( nsteps < 1) {
+        cout << "Error: nsteps must be positive" << endl;
+        return 1;
+    }
+
+    Mesh srcmesh, currmesh;
+    string errmsg;
+    if( !loadMesh( meshfile, srcmesh, errmsg) ) {
+        cout << "Error: " << errmsg << endl;
+        return 1;
+    }
+
+    vector<SteadyMotion> handles( argc - 6);
+    for( size_t i = 0; i < handles.size(); i++) {
+        if( !handles[i].readAffinityMatrix( argv[6+i], errmsg) ) {
+            cout << "Error: " << errmsg << endl;
+            return 1;
+        }
+    }
+
+    SkinWeights weights;
+    if( !readSkinWeights( weightfile, srcmesh.getNumNodes(), weights, errmsg) ) {
+        cout << "Error: " << errmsg << endl;
+        return 1;
+    }
+    if( weights.getMaxHandle() >= (int)handles.size() ) {
+        cout << "Error: " << weightfile << " refers to handle " << weights.getMaxHandle()
+             << " but only " << handles.size() << " are given" << endl;
+        return 1;
+    }
+
+    Skinning skinning;
+    skinning.setHandles(handles);
+    skinning.setWeights(weights);
+
+    mkdir( outdir.c_str(), 0755);
+
+    currmesh.coords = srcmesh.coords;
+    currmesh.shareConnectivity(srcmesh);
+
+    double computeTime = 0.0, writeTime = 0.0;
+    for( int k = 0; k <= nsteps; k++) {
+        auto t0 = Clock::now();
+        skinning.apply( (double)k/nsteps, srcmesh, currmesh);
+        auto t1 = Clock::now();
+
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%05d.obj", k);
+        if( !currmesh.saveAs( outdir + name) ) return 1;
+
+        auto t2 = Clock::now();
+        computeTime += chrono::duration<double>(t1 - t0).count();
+        writeTime   += chrono::duration<double>(t2 - t1).count();
+        PROFILE_FRAME();
+    }
+
+    cout << "Handles    : " << handles.size() << ", at most " << MAX_INFLUENCES << " per vertex" << endl;
+    reportTimes( srcmesh, nsteps + 1, computeTime, writeTime);
+    return 0;
+}
+
+static bool hasSuffix( const string &s, const string &suffix)
+{
+    return s.size() > suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static int extractFrame( int argc, char **argv)
+{
+    if( argc != 5) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Trajectory traj;
+    string errmsg;
+    if( !traj.read( argv[2], errmsg) ) {
+        cout << "Error: " << errmsg << endl;
+        return 1;
+    }
+
+    long k = atol(argv[3]);
+    if( k < 0 || k >= (long)traj.getNumFrames() ) {
+        cout << "Error: " << argv[2] << " has frames 0 to " << (long)traj.getNumFrames() - 1 << endl;
+        return 1;
+    }
+
+    Mesh frame;
+    frame.coords.resize( traj.getMesh().coords.size() );
+    frame.shareConnectivity( traj.getMesh() );
+    traj.getFrame( k, frame);
+    return frame.saveAs( argv[4] ) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if( argc > 1 && string(argv[1]) == "-skin")
+        return skinFrames( argc, argv);
+
+    if( argc > 1 && string(argv[1]) == "-frame")
+        return extractFrame( argc, argv);
+
+    if( argc != 5 && argc != 6) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    string meshfile = argv[1];
+    string xffile   = argv[2];
+    int    nsteps   = atoi(argv[3]);
+    string outdir   = argv[4];
+    double tolerance = argc == 6 ? atof(argv[5]) : 0.0;
+
+    if( nsteps < 1) {
+        cout << "Error: nsteps must be positive" << endl;
+        return 1;
+    }
+
+    if( argc == 6 && tolerance <= 0.0) {
+        cout << "Error: tolerance must be positive" << endl;
+        return 1;
+    }
+
+    bool chain = hasSuffix( xffile, ".kf");
+    bool store = hasSuffix( outdir, ".traj");
+    if( chain && tolerance > 0.0) {
+        cout << "Error: a tolerance only applies to a single .xf motion" << endl;
+        return 1;
+    }
+
+    Mesh srcmesh, currmesh;
+    SteadyMotion   motion;
+    KeyframeMotion keyframes;
+    string errmsg;
+
+    if( !loadMesh( meshfile, srcmesh, errmsg) ||
+        !(chain ? keyframes.readKeyframes( xffile, errmsg) : motion.readAffinityMatrix( xffile, errmsg)) ) {
+        cout << "Error: " << errmsg << endl;
+        return 1;
+    }
+
+    if( !store) mkdir( outdir.c_str(), 0755);
+
+    currmesh.coords = srcmesh.coords;
+    currmesh.shareConnectivity(srcmesh);
+
+    Trajectory traj;
+    if( store) traj.setMesh(srcmesh);
+
+    MotionStepper stepper;
+    if( tolerance > 0.0)
+        stepper.start( motion, 1.0/nsteps, tolerance);
+
+    double computeTime = 0.0, writeTime = 0.0;
+
+    for( int k = 0; k <= nsteps; k++) {
+        auto t0 = Clock::now();
+
+        double t = (double)k/nsteps;
+        if( chain)
+            t = keyframes.getStartTime() + (keyframes.getEndTime() - keyframes.getStartTime())*t;
+
+        Eigen::Matrix4d At;
+        if( chain)
+            At = keyframes.getMatrix(t);
+        else if( tolerance > 0.0)
+            At = k == 0 ? stepper.getMatrix() : stepper.step();
+        else
+            At = motion.getMatrix(t);
+
+        // A stored trajectory needs the matrix only.
+        if( store)
+            traj.addFrame( t, At);
+        else
+            applyMotion( At, srcmesh, currmesh);
+
+        auto t1 = Clock::now();
+
+        if( !store) {
+            char name[32];
+            snprintf(name, sizeof(name), "/frame_%05d.obj", k);
+            if( !currmesh.saveAs( outdir + name) ) return 1;
+        }
+
+        auto t2 = Clock::now();
+        computeTime += chrono::duration<double>(t1 - t0).count();
+        writeTime   += chrono::duration<double>(t2 - t1).count();
+        PROFILE_FRAME();
+    }
+
+    if( store) {
+        auto t0 = Clock::now();
+        if( !traj.write( outdir, errmsg) ) {
+            cout << "Error: " << errmsg << endl;
+            return 1;
+        }
+        writeTime += chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    if( chain)
+        cout << "Keyframes  : " << keyframes.getNumKeyframes() << ", t = "
+             << keyframes.getStartTime() << " to " << keyframes.getEndTime() << endl;
+    reportTimes( srcmesh, nsteps + 1, computeTime, writeTime);
+
+    if( tolerance > 0.0) {
+        cout << "Resync     : every " << stepper.getResyncInterval() << " steps, "
+             << stepper.getNumResyncs() << " times" << endl;
+        cout << "Drift      : " << stepper.getMaxError() << " max at resync, "
+             << stepper.getError() << " at last step" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,570 @@
+#include "SteadyMotion.h"
+#include "KeyframeMotion.h"
+#include "Skinning.h"
+#include "FramePipeline.h"
+#include "Trajectory.h"
+#include "MeshIO.h"
+#include "MeshWriter.h"
+#include "TransformKernel.h"
+#include "TransformBatch.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+using namespace std;
+
+// Microbenchmarks for mesh loading, topology, the per-frame work and the
+// AffineLib kernels. Every benchmark is run once to warm up, then timed in a
+// number of samples; a sample repeats the call often enough to last at least
+// MIN_SAMPLE_TIME. The statistics are reported per operation, e.g. per matrix
+// for the AffineLib kernels, as CSV or JSON on stdout.
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+const double MIN_SAMPLE_TIME = 0.02;
+
+// Results are accumulated here so that the compiler cannot drop the calls.
+volatile double sink;
+
+struct Result
+{
+    string group, name, input;
+    size_t opsPerCall;
+    size_t callsPerSample;
+    vector<double> samples;     // seconds per operation
+};
+
+struct Bench
+{
+    int  numSamples = 10;
+    bool json = 0;
+    string filter;
+    vector<Result> results;
+
+    // Time fn, which performs ops operations per call.
+    void run( const string &group, const string &name, const string &input,
+              size_t ops, const function<void()> &fn);
+    void report() const;
+};
+
+// Contents of a JSON string literal holding s.
+string jsonEscape( const string &s)
+{
+    string out;
+    for( unsigned char c : s) {
+        if( c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if( c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+double seconds( Clock::time_point t0, Clock::time_point t1)
+{
+    return chrono::duration<double>(t1 - t0).count();
+}
+
+void Bench::run( const string &group, const string &name, const string &input,
+                 size_t ops, const function<void()> &fn)
+{
+    if( !filter.empty() && group.find(filter) == string::npos && name.find(filter) == string::npos)
+        return;
+
+    auto t0 = Clock::now();
+    fn();
+    double once = max( seconds(t0, Clock::now()), 1.0e-9);
+
+    Result r;
+    r.group = group;
+    r.name  = name;
+    r.input = input;
+    r.opsPerCall     = ops;
+    r.callsPerSample = max( (size_t)1, (size_t)(MIN_SAMPLE_TIME/once));
+
+    for( int i = 0; i < numSamples; i++) {
+        auto t1 = Clock::now();
+        for( size_t j = 0; j < r.callsPerSample; j++)
+            fn();
+        auto t2 = Clock::now();
+        r.samples.push_back( seconds(t1, t2)/(r.callsPerSample*ops) );
+    }
+
+    results.push_back(r);
+    cerr << group << "/" << name << " " << input << ": "
+         << *min_element(r.samples.begin(), r.samples.end())*1.0e9 << " ns/op" << endl;
+}
+
+void Bench::report() const
+{
+    if( json) {
+        printf("{\n  \"threads\": %d,\n  \"simd\": \"%s\",\n  \"benchmarks\": [\n",
+               ThreadPool::instance().getNumThreads(), getSimdName(getSimdLevel()));
+    } else {
+        printf("group,name,input,ops_per_call,calls_per_sample,samples,"
+               "min_ns,median_ns,mean_ns,stddev_ns\n");
+    }
+
+    for( size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        vector<double> s = r.samples;
+        sort(s.begin(), s.end());
+
+        size_t n = s.size();
+        double median = n % 2 ? s[n/2] : 0.5*(s[n/2-1] + s[n/2]);
+        double mean = 0.0, var = 0.0;
+        for( double x : s) mean += x;
+        mean /= n;
+        for( double x : s) var += (x - mean)*(x - mean);
+        double stddev = n > 1 ? sqrt(var/(n - 1)) : 0.0;
+
+        if( json) {
+            printf("    {\"group\": \"%s\", \"name\": \"%s\", \"input\": \"%s\", "
+                   "\"ops_per_call\": %zu, \"calls_per_sample\": %zu, \"samples\": %zu, "
+                   "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f}%s\n",
+                   jsonEscape(r.group).c_str(), jsonEscape(r.name).c_str(), jsonEscape(r.input).c_str(),
+                   r.opsPerCall, r.callsPerSample, n,
+                   s[0]*1.0e9, median*1.0e9, mean*1.0e9, stddev*1.0e9,
+                   i + 1 < results.size() ? "," : "");
+        } else {
+            printf("%s,%s,%s,%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f\n",
+                   r.group.c_str(), r.name.c_str(), r.input.c_str(), r.opsPerCall, r.callsPerSample, n,
+                   s[0]*1.0e9, median*1.0e9, mean*1.0e9, stddev*1.0e9);
+        }
+    }
+
+    if( json) printf("  ]\n}\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Build the pointer view the old way, one addFace() at a time.
+void addFaces( const Mesh &src, Mesh &m)
+{
+    m.clearTopology();
+    m.coords = src.coords;
+    m.shareConnectivity(src);
+
+    size_t numnodes = m.getNumNodes();
+    size_t numfaces = m.getNumFaces();
+    const int *tri  = m.getTriangles().data();
+
+    m.nodes.resize(numnodes);
+    for( size_t i = 0; i < numnodes; i++) {
+        NodePtr v  = m.newNode();
+        v->xyz     = m.getXYZ(i);
+        v->id      = i;
+        m.nodes[i] = v;
+    }
+
+    for( size_t i = 0; i < numfaces; i++) {
+        FacePtr f = m.newFace( m.nodes[tri[3*i+0]], m.nodes[tri[3*i+1]], m.nodes[tri[3*i+2]] );
+        f->id = i;
+        m.addFace(f);
+    }
+}
+
+void benchMesh( Bench &bench, const string &filename)
+{
+    Mesh src;
+    string errmsg;
+    if( !readOFF( filename, src, errmsg) ) {
+        cerr << "Warning: " << errmsg << endl;
+        return;
+    }
+
+    bench.run( "load", "readOFF", filename, 1, [&]() {
+        src = Mesh();
+        readOFF( filename, src, errmsg);
+    });
+
+    // The cache holds the adjacency tables as well, which are mapped and
+    // checked rather than built.
+    src = Mesh();
+    loadMesh( filename, src, errmsg, 1, 1);
+    string cachefile = getMeshCacheName(filename);
+    bench.run( "load", "readMeshCache", filename, 1, [&]() {
+        Mesh m;
+        readMeshCache( cachefile, m, errmsg, filename);
+        sink = m.getTopology().getNumEdges();
+    });
+
+    // The mesh as binary PLY: positions mapped, face lists converted.
+    char plyname[] = "/tmp/sambenchXXXXXX.ply";
+    int plyfd = mkstemps(plyname, 4);
+    if( plyfd >= 0) {
+        close(plyfd);
+        writePLY( plyname, src, errmsg);
+        bench.run( "load", "readPLY", filename, 1, [&]() {
+            Mesh m;
+            readPLY( plyname, m, errmsg);
+            sink = m.coords[0];
+        });
+        unlink(plyname);
+    }
+
+    size_t numnodes = src.getNumNodes();
+    size_t numfaces = src.getNumFaces();
+
+    bench.run( "topology", "MeshTopology::build", filename, numfaces, [&]() {
+        MeshTopology t;
+        t.build( src.getTriangles().data(), numfaces, numnodes);
+        sink = t.getNumEdges();
+    });
+
+    Mesh view;
+    bench.run( "topology", "Mesh::addFace", filename, numfaces, [&]() {
+        addFaces( src, view);
+    });
+
+    bench.run( "topology", "Mesh::buildTopology", filename, numfaces, [&]() {
+        view.buildTopology();
+    });
+    view.clearTopology();
+
+    SteadyMotion motion;
+    Eigen::Matrix4d A = Eigen::Matrix4d::Identity();
+    A.topLeftCorner<3,3>() = Eigen::AngleAxisd(1.0, Eigen::Vector3d(1.0, 2.0, 3.0).normalized()).toRotationMatrix();
+    A.block<1,3>(3,0) << 0.1, 0.2, 0.3;
+    motion.setMatrix(A);
+    Eigen::Matrix4d At = motion.getMatrix(0.37);
+
+    Mesh curr;
+    curr.coords = src.coords;
+    curr.shareConnectivity(src);
+    src.setVertexNormals();
+
+    bench.run( "frame", "applyMotion", filename, numnodes, [&]() {
+        applyMotion( At, src, curr);
+    });
+
+    bench.run( "frame", "applyNormalMotion", filename, numfaces + numnodes, [&]() {
+        applyNormalMotion( At, src, curr);
+    });
+
+    // One frame through the worker thread: request it, then poll until it
+    // can be acquired, as the viewer does on every animation tick.
+    FramePipeline pipeline;
+    pipeline.start( src, [&](double t, Mesh &dst) {
+        Eigen::Matrix4d Mt = motion.getMatrix(t);
+        applyMotion( Mt, src, dst);
+        applyNormalMotion( Mt, src, dst);
+    });
+    double playTime = 0.0;
+    bench.run( "frame", "FramePipeline round trip", filename, numnodes, [&]() {
+        pipeline.request( playTime += 1.0e-3 );
+        while( !pipeline.acquire() ) this_thread::yield();
+    });
+    pipeline.stop();
+
+    // Random access to the frames of a stored 100-step trajectory.
+    Trajectory traj;
+    traj.setMesh(src);
+    for( int k = 0; k <= 100; k++)
+        traj.addFrame( k/100.0, motion.getMatrix(k/100.0) );
+    size_t frame = 0;
+    bench.run( "frame", "Trajectory::getFrame", filename, numnodes, [&]() {
+        frame = (frame + 37) % traj.getNumFrames();
+        traj.getFrame( frame, curr);
+    });
+
+    // 32 handles at random vertices, each vertex weighted by the inverse
+    // squared distances to them; rigid handles, then ones that also shear.
+    const int NUM_HANDLES = 32;
+    mt19937 rng(12345);
+    uniform_real_distribution<double> uniform(-1.0, 1.0);
+    vector<SteadyMotion> rigid(NUM_HANDLES), affine(NUM_HANDLES);
+    vector<int> centre(NUM_HANDLES);
+    for( int i = 0; i < NUM_HANDLES; i++) {
+        Eigen::Vector3d axis(uniform(rng), uniform(rng), uniform(rng));
+        Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+        H.topLeftCorner<3,3>() = Eigen::AngleAxisd(uniform(rng), axis.normalized()).toRotationMatrix();
+        H.block<1,3>(3,0) << 0.1*uniform(rng), 0.1*uniform(rng), 0.1*uniform(rng);
+        rigid[i].setMatrix(H);
+
+        Eigen::Matrix3d D = Eigen::Vector3d(1.2, 0.9, 1.0).asDiagonal();
+        H.topLeftCorner<3,3>() = D*H.topLeftCorner<3,3>();
+        affine[i].setMatrix(H);
+
+        centre[i] = rng() % numnodes;
+    }
+
+    SkinWeights weights;
+    weights.resize(numnodes);
+    vector<int>   h(NUM_HANDLES);
+    vector<float> w(NUM_HANDLES);
+    for( size_t v = 0; v < numnodes; v++) {
+        const float *p = src.getXYZ(v);
+        for( int i = 0; i < NUM_HANDLES; i++) {
+            const float *c = src.getXYZ(centre[i]);
+            float dx = p[0] - c[0], dy = p[1] - c[1], dz = p[2] - c[2];
+            h[i] = i;
+            w[i] = 1.0f/(dx*dx + dy*dy + dz*dz + 1.0e-6f);
+        }
+        weights.set( v, h.data(), w.data(), NUM_HANDLES);
+    }
+
+    Skinning skinning;
+    skinning.setWeights(weights);
+    skinning.setHandles(rigid);
+    bench.run( "frame", "Skinning::apply rigid", filename, numnodes, [&]() {
+        skinning.apply( 0.37, src, curr);
+    });
+    skinning.setHandles(affine);
+    bench.run( "frame", "Skinning::apply affine", filename, numnodes, [&]() {
+        skinning.apply( 0.37, src, curr);
+    });
+
+    bench.run( "frame", "setSurfaceNormals", filename, numfaces, [&]() {
+        curr.setSurfaceNormals();
+    });
+
+    bench.run( "frame", "setVertexNormals", filename, numnodes, [&]() {
+        curr.setVertexNormals();
+    });
+
+    char tmpname[] = "/tmp/sambenchXXXXXX";
+    int fd = mkstemp(tmpname);
+    if( fd >= 0) {
+        close(fd);
+        bench.run( "frame", "saveAs", filename, numnodes, [&]() {
+            curr.saveAs(tmpname);
+        });
+        string errmsg;
+        bench.run( "frame", "writeOFF", filename, numnodes, [&]() {
+            writeOFF( tmpname, curr, errmsg);
+        });
+        bench.run( "frame", "writePLY", filename, numnodes, [&]() {
+            writePLY( tmpname, curr, errmsg);
+        });
+        unlink(tmpname);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void benchAffineLib( Bench &bench)
+{
+    using namespace AffineLib;
+
+    // The same pseudo-random inputs on every run.
+    const size_t N = 256;
+    mt19937 rng(12345);
+    uniform_real_distribution<double> uniform(-1.0, 1.0);
+    auto random3 = [&]() {
+        Matrix3d m;
+        for( int i = 0; i < 9; i++) m(i/3, i%3) = uniform(rng);
+        return m;
+    };
+
+    vector<Matrix4d> logRigid(N), rigid(N);
+    vector<Matrix3d> sym(N), spd(N), small(N), general(N);
+    for( size_t i = 0; i < N; i++) {
+        Matrix3d w = random3();
+        Matrix3d skew = 1.5*(w - w.transpose())/2.0;
+        Vector3d l(uniform(rng), uniform(rng), uniform(rng));
+        logRigid[i] = pad( skew, l, 0.0);
+        rigid[i]    = expSE(logRigid[i]);
+
+        Matrix3d s = random3();
+        sym[i] = (s + s.transpose())/2.0;
+        spd[i] = expSym(sym[i]);
+
+        small[i]   = 0.5*random3();
+        general[i] = Id3 + 0.3*random3();
+    }
+
+    double sum = 0.0;
+    bench.run( "affinelib", "expSE", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += expSE(logRigid[i])(0,0);
+    });
+    bench.run( "affinelib", "logSEc", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += logSEc(rigid[i])(0,1);
+    });
+    bench.run( "affinelib", "expSym", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += expSym(sym[i])(0,0);
+    });
+    bench.run( "affinelib", "logSym", "random", N, [&]() {
+        Vector3d lambda;
+        for( size_t i = 0; i < N; i++) sum += logSym(spd[i], lambda)(0,0);
+    });
+    bench.run( "affinelib", "expTaylor", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += expTaylor(small[i])(0,0);
+    });
+    bench.run( "affinelib", "expPade", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += expPade(small[i])(0,0);
+    });
+    bench.run( "affinelib", "logTaylor", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += logTaylor(general[i])(0,0);
+    });
+    bench.run( "affinelib", "logPade", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += logPade(general[i])(0,0);
+    });
+
+    // The float instantiations on the same inputs.
+    vector<Matrix4f> logRigidF(N), rigidF(N);
+    vector<Matrix3f> symF(N);
+    for( size_t i = 0; i < N; i++) {
+        logRigidF[i] = logRigid[i].cast<float>();
+        rigidF[i]    = rigid[i].cast<float>();
+        symF[i]      = sym[i].cast<float>();
+    }
+    float sumF = 0.0f;
+    bench.run( "affinelib", "expSE<float>", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sumF += expSE(logRigidF[i])(0,0);
+    });
+    bench.run( "affinelib", "logSEc<float>", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sumF += logSEc(rigidF[i])(0,1);
+    });
+    bench.run( "affinelib", "expSym<float>", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sumF += expSym(symF[i])(0,0);
+    });
+    sum += sumF;
+
+    TransformBatch logBatch, rigidBatch, outBatch;
+    logBatch.resize(N);
+    rigidBatch.resize(N);
+    for( size_t i = 0; i < N; i++) {
+        logBatch.set(i, logRigid[i]);
+        rigidBatch.set(i, rigid[i]);
+    }
+    bench.run( "affinelib", "expSEBatch", "random", N, [&]() {
+        expSEBatch(logBatch, outBatch);
+        sum += outBatch.m[0][0];
+    });
+    bench.run( "affinelib", "logSEcBatch", "random", N, [&]() {
+        logSEcBatch(rigidBatch, outBatch);
+        sum += outBatch.m[1][0];
+    });
+
+    // The batch kernels against the scalar functions near the identity, where
+    // both switch to series, down to pure translations.
+    const size_t NEAR = 64;
+    vector<Matrix4d> logNear(NEAR), rigidNear(NEAR);
+    TransformBatch logNearBatch, rigidNearBatch;
+    logNearBatch.resize(NEAR);
+    rigidNearBatch.resize(NEAR);
+    for( size_t i = 0; i < NEAR; i++) {
+        Matrix3d w = random3();
+        Matrix3d skew = (w - w.transpose()).normalized();
+        double angle = i == 0 ? 0.0 : pow(10.0, -12.0 + 11.0*i/NEAR);
+        Vector3d l(uniform(rng), uniform(rng), uniform(rng));
+        logNear[i]   = pad( Matrix3d(angle*skew), l, 0.0);
+        rigidNear[i] = expSE(logNear[i]);
+        logNearBatch.set(i, logNear[i]);
+        rigidNearBatch.set(i, rigidNear[i]);
+    }
+    double expDiff = 0.0, logDiff = 0.0;
+    expSEBatch(logNearBatch, outBatch);
+    for( size_t i = 0; i < NEAR; i++)
+        expDiff = max(expDiff, (outBatch.get(i) - expSE(logNear[i])).cwiseAbs().maxCoeff());
+    logSEcBatch(rigidNearBatch, outBatch);
+    for( size_t i = 0; i < NEAR; i++)
+        logDiff = max(logDiff, (outBatch.get(i, 0.0) - logSEc(rigidNear[i])).cwiseAbs().maxCoeff());
+    cerr << "affinelib/expSEBatch near identity: max difference " << expDiff << endl;
+    cerr << "affinelib/logSEcBatch near identity: max difference " << logDiff << endl;
+    if( expDiff > 1.0e-12 || logDiff > 1.0e-12)
+        cerr << "Warning: batch kernels disagree with AffineLib near the identity" << endl;
+
+    // A chain through 1024 keyframes, each moved on from the last by one of
+    // the rigid motions above, sampled at random times.
+    const size_t K = 1024;
+    vector<double>   keyTimes(K);
+    vector<Matrix4d> keyPoses(K);
+    for( size_t i = 0; i < K; i++) {
+        keyTimes[i] = i + 0.5*(uniform(rng) + 1.0)*0.9;
+        keyPoses[i] = i == 0 ? Matrix4d(Matrix4d::Identity()) : Matrix4d(keyPoses[i-1]*rigid[i % N]);
+    }
+    vector<double> seeks(N);
+    for( size_t i = 0; i < N; i++) seeks[i] = 0.5*(uniform(rng) + 1.0)*K;
+
+    KeyframeMotion keyframes;
+    string errmsg;
+    bench.run( "motion", "KeyframeMotion::setKeyframes", "random", K, [&]() {
+        keyframes.setKeyframes( keyTimes, keyPoses, errmsg);
+    });
+    bench.run( "motion", "KeyframeMotion::getMatrix", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) sum += keyframes.getMatrix(seeks[i])(3,0);
+    });
+    bench.run( "motion", "SteadyMotion::getMatrix", "random", N, [&]() {
+        const SteadyMotion &segment = keyframes.getSegment(0);
+        for( size_t i = 0; i < N; i++) sum += segment.getMatrix(seeks[i]/K)(3,0);
+    });
+
+    Matrix3d U, S, R;
+    Vector3d s;
+    bench.run( "polar", "polarDiag", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) { polarDiag(general[i], U, s, R); sum += R(0,0); }
+    });
+    bench.run( "polar", "polarBySVD", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) { polarBySVD(general[i], U, s, R); sum += R(0,0); }
+    });
+    bench.run( "polar", "polarByParam", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) { polarByParam(general[i], S, R); sum += R(0,0); }
+    });
+    bench.run( "polar", "polarHigham", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) { polarHigham(general[i], S, R); sum += R(0,0); }
+    });
+    bench.run( "polar", "polarN<3>", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) { polarN(general[i], S, R); sum += R(0,0); }
+    });
+    MatrixXd dynS, dynR;
+    bench.run( "polar", "polarN<Dynamic>", "random", N, [&]() {
+        for( size_t i = 0; i < N; i++) { polarN(MatrixXd(general[i]), dynS, dynR); sum += dynR(0,0); }
+    });
+    sink = sum;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+    Bench bench;
+    vector<string> meshes;
+
+    for( int i = 1; i < argc; i++) {
+        if( !strcmp(argv[i], "-json") ) {
+            bench.json = 1;
+        } else if( !strcmp(argv[i], "-csv") ) {
+            bench.json = 0;
+        } else if( !strcmp(argv[i], "-samples") && i + 1 < argc) {
+            bench.numSamples = max(1, atoi(argv[++i]));
+        } else if( !strcmp(argv[i], "-filter") && i + 1 < argc) {
+            bench.filter = argv[++i];
+        } else if( argv[i][0] == '-') {
+            cout << "Usage: " << argv[0] << " [-csv|-json] [-samples n] [-filter name] [mesh.off ...]" << endl;
+            return 1;
+        } else {
+            meshes.push_back(argv[i]);
+        }
+    }
+
+    if( meshes.empty() ) meshes = {"srcmesh.off", "model.off"};
+
+    for( const string &m : meshes)
+        benchMesh( bench, m);
+    benchAffineLib(bench);
+
+    bench.report();
+    return 0;
+}